@@ -0,0 +1,565 @@
+//__________________________________________________________________________
+//   BATCH VERSIONS OF THE SPECTRA PROCESSING FUNCTIONS                    //
+//                                                                         //
+//   One .Call processes a whole matrix of spectra, one spectrum per       //
+//   column. The columns are distributed over OpenMP threads; every       //
+//   thread works in its own working space arena and every column is      //
+//   processed by the same code as a single spectrum, so the result does   //
+//   not depend on the number of threads. The Gaussian fits of the peaks  //
+//   of one spectrum are distributed over the threads the same way.       //
+//____________________________________________________________________________
+
+#include <stdlib.h>
+
+#include <R.h>
+#include <Rinternals.h>
+
+#include "spectrum.h"
+
+static const double *BatchColumn(const double *spectra, const int *counts,
+                                 int k, int ssize)
+{
+//column k of a numeric matrix, or of an integer matrix converted into the
+//arena of the calling thread (NULL when out of memory)
+   const int *column;
+   double *values;
+   int i;
+   if (counts == NULL)
+      return spectra + (size_t) k * ssize;
+   values = SpectrumWorkspaceAlloc(ssize);
+   if (values == NULL)
+      return NULL;
+   column = counts + (size_t) k * ssize;
+   for (i = 0; i < ssize; i++)
+      values[i] = column[i] == NA_INTEGER ? NA_REAL : column[i];
+   return values;
+}
+
+SEXP R_SpectrumBackgroundBatch(SEXP R_spectra,
+                               SEXP R_numberIterations,
+                               SEXP R_direction, SEXP R_filterOrder,
+                               SEXP R_smoothing, SEXP R_smoothWindow,
+                               SEXP R_compton, SEXP R_threads)
+{
+/////////////////////////////////////////////////////////////////////////////
+//        BACKGROUND OF A MATRIX OF SPECTRA
+//
+//        R_spectra-numeric or integer matrix, one spectrum per column
+//        the other parameters are those of R_SpectrumBackground
+//        R_threads-number of threads, NA for all processors
+//
+//        Returns the matrix of backgrounds.
+//
+/////////////////////////////////////////////////////////////////////////////
+   const double *spectra = TYPEOF(R_spectra) == REALSXP ? REAL(R_spectra) : NULL;
+   const int *counts = TYPEOF(R_spectra) == INTSXP ? INTEGER(R_spectra) : NULL;
+   int ssize = nrows(R_spectra);
+   int count = ncols(R_spectra);
+   int numberIterations = INTEGER(R_numberIterations)[0];
+   int direction = INTEGER(R_direction)[0];
+   int filterOrder = INTEGER(R_filterOrder)[0];
+   int smoothing = INTEGER(R_smoothing)[0];
+   int smoothWindow = INTEGER(R_smoothWindow)[0];
+   int compton = INTEGER(R_compton)[0];
+   int k, failed = 0;
+   double *background;
+   const char *message = 0;
+   SEXP f;
+
+   if (spectra == NULL && counts == NULL)
+      Rf_error( "Spectra must be a numeric or integer matrix");
+   PROTECT(f = allocMatrix(REALSXP, ssize, count));
+   background = REAL(f);
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(SpectrumThreads(INTEGER(R_threads)[0])) schedule(dynamic)
+#endif
+   for (k = 0; k < count; k++) {
+      const char *error;
+      const double *column;
+      size_t mark = SpectrumWorkspaceMark();
+      int stop;
+#ifdef _OPENMP
+#pragma omp atomic read
+#endif
+      stop = failed;
+      if (stop)
+         continue;
+      column = BatchColumn(spectra, counts, k, ssize);
+      if (column == NULL)
+         error = "Not enough memory for working space";
+      else
+         error = SpectrumBackground(column,
+                                    background + (size_t) k * ssize, ssize,
+                                    numberIterations, direction, filterOrder,
+                                    smoothing, smoothWindow, compton);
+      SpectrumWorkspaceRelease(mark);
+      if (error != 0) {
+#ifdef _OPENMP
+#pragma omp critical(rPeaksBatchError)
+#endif
+         message = error;
+#ifdef _OPENMP
+#pragma omp atomic write
+#endif
+         failed = 1;
+      }
+   }
+   SpectrumWorkspaceReset();
+   if (message != 0)
+      Rf_error( "%s", message);
+   UNPROTECT(1);
+   return f;
+}
+
+SEXP R_SpectrumSearchBatch(SEXP R_spectra,
+                           SEXP R_sigma, SEXP R_threshold,
+                           SEXP R_backgroundRemove, SEXP R_deconIterations,
+                           SEXP R_markov, SEXP R_averWindow,
+                           SEXP R_acceleration, SEXP R_threads)
+{
+/////////////////////////////////////////////////////////////////////////////
+//        PEAK SEARCH IN A MATRIX OF SPECTRA
+//
+//        R_spectra-numeric or integer matrix, one spectrum per column
+//        the other parameters are those of R_SpectrumSearchHighRes
+//        R_threads-number of threads, NA for all processors
+//
+//        Returns a list of three vectors of equal length, one element per
+//        found peak: spectrum (column number), position (channel, as
+//        R_SpectrumSearchHighRes) and height (deconvolved spectrum at the
+//        position). The peaks of a spectrum are in the order of
+//        R_SpectrumSearchHighRes, the spectra in the order of the columns.
+//
+/////////////////////////////////////////////////////////////////////////////
+   const double *spectra = TYPEOF(R_spectra) == REALSXP ? REAL(R_spectra) : NULL;
+   const int *counts = TYPEOF(R_spectra) == INTSXP ? INTEGER(R_spectra) : NULL;
+   int ssize = nrows(R_spectra);
+   int count = ncols(R_spectra);
+   double sigma = REAL(R_sigma)[0];
+   double threshold = REAL(R_threshold)[0];
+   int backgroundRemove = INTEGER(R_backgroundRemove)[0];
+   int deconIterations = INTEGER(R_deconIterations)[0];
+   int markov = INTEGER(R_markov)[0];
+   int averWindow = INTEGER(R_averWindow)[0];
+   int acceleration = INTEGER(R_acceleration)[0];
+   int k, i, n, failed = 0, full = 0;
+   int *npeaks;
+   double **peaks;
+   const char *message = 0;
+   SEXP ans, ans_names, id, position, height;
+
+   if (spectra == NULL && counts == NULL)
+      Rf_error( "Spectra must be a numeric or integer matrix");
+//peaks of every spectrum, (position, height) pairs, collected in parallel
+   npeaks = (int *) R_alloc(count, sizeof(int));
+   peaks = (double **) R_alloc(count, sizeof(double *));
+   for (k = 0; k < count; k++)
+      npeaks[k] = 0, peaks[k] = NULL;
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(SpectrumThreads(INTEGER(R_threads)[0])) schedule(dynamic)
+#endif
+   for (k = 0; k < count; k++) {
+      const char *error = 0;
+      size_t mark = SpectrumWorkspaceMark();
+      const double *column;
+      double *position_x, *dest;
+      int j, found = 0, stop;
+#ifdef _OPENMP
+#pragma omp atomic read
+#endif
+      stop = failed;
+      if (stop)
+         continue;
+      column = BatchColumn(spectra, counts, k, ssize);
+      position_x = SpectrumWorkspaceAlloc(ssize);
+      dest = SpectrumWorkspaceAlloc(ssize);
+      if (column == NULL || position_x == NULL || dest == NULL)
+         error = "Not enough memory for working space";
+      else
+         error = SpectrumSearchHighRes(column, dest,
+                                       ssize, sigma, threshold,
+                                       backgroundRemove, deconIterations,
+                                       markov, averWindow, acceleration,
+                                       NULL, NULL, position_x, NULL, ssize,
+                                       &found);
+      if (error == 0 && found > 0) {
+         peaks[k] = (double *) malloc(2 * (size_t) found * sizeof(double));
+         if (peaks[k] == NULL)
+            error = "Not enough memory for working space";
+         else {
+            for (j = 0; j < found; j++) {
+               peaks[k][2 * j] = (int) position_x[j] + 1;
+               peaks[k][2 * j + 1] = dest[(int) position_x[j]];
+            }
+            npeaks[k] = found;
+            if (found == ssize) {
+#ifdef _OPENMP
+#pragma omp atomic write
+#endif
+               full = 1;
+            }
+         }
+      }
+      SpectrumWorkspaceRelease(mark);
+      if (error != 0) {
+#ifdef _OPENMP
+#pragma omp critical(rPeaksBatchError)
+#endif
+         message = error;
+#ifdef _OPENMP
+#pragma omp atomic write
+#endif
+         failed = 1;
+      }
+   }
+   SpectrumWorkspaceReset();
+   if (message != 0) {
+      for (k = 0; k < count; k++)
+         free(peaks[k]);
+      Rf_error( "%s", message);
+   }
+
+//gather the peaks in the order of the columns
+   for (k = 0, n = 0; k < count; k++)
+      n += npeaks[k];
+   PROTECT(id = allocVector(INTSXP, n));
+   PROTECT(position = allocVector(INTSXP, n));
+   PROTECT(height = allocVector(REALSXP, n));
+   for (k = 0, n = 0; k < count; k++) {
+      for (i = 0; i < npeaks[k]; i++, n++) {
+         INTEGER(id)[n] = k + 1;
+         INTEGER(position)[n] = (int) peaks[k][2 * i];
+         REAL(height)[n] = peaks[k][2 * i + 1];
+      }
+      free(peaks[k]);
+   }
+   PROTECT(ans = allocVector(VECSXP, 3));
+   PROTECT(ans_names = allocVector(STRSXP, 3));
+   SET_VECTOR_ELT(ans, 0, id);
+   SET_VECTOR_ELT(ans, 1, position);
+   SET_VECTOR_ELT(ans, 2, height);
+   SET_STRING_ELT(ans_names, 0, mkChar("spectrum"));
+   SET_STRING_ELT(ans_names, 1, mkChar("position"));
+   SET_STRING_ELT(ans_names, 2, mkChar("height"));
+   setAttrib(ans, R_NamesSymbol, ans_names);
+   UNPROTECT(5);
+   if (full)
+      Rf_warning( "Peak buffer full");
+   return ans;
+}
+
+SEXP R_SpectrumFitPeaks(SEXP R_x, SEXP R_y, SEXP R_positions,
+                        SEXP R_cutoff, SEXP R_maxIterations, SEXP R_tol,
+                        SEXP R_threads)
+{
+/////////////////////////////////////////////////////////////////////////////
+//        GAUSSIAN FITS OF ALL PEAKS OF A SPECTRUM
+//
+//        R_x,R_y-numeric vectors of the spectrum
+//        R_positions-integer vector of the channels of the peaks (1-based)
+//        R_cutoff-fraction of the height of a peak bounding its window
+//        R_maxIterations,R_tol-see SpectrumFitGaussian
+//        R_threads-number of threads, NA for all processors
+//
+//        Returns a list of vectors, one element per peak. A peak whose
+//        fit fails has NA estimates and converged FALSE.
+//
+/////////////////////////////////////////////////////////////////////////////
+   static const char *names[] = {"position", "mu", "sigma", "height",
+                                 "mu_se", "sigma_se", "height_se", "lower",
+                                 "upper", "iterations", "converged"};
+   static const SEXPTYPE types[] = {INTSXP, REALSXP, REALSXP, REALSXP,
+                                    REALSXP, REALSXP, REALSXP, INTSXP,
+                                    INTSXP, INTSXP, LGLSXP};
+   const double *x = REAL(R_x), *y = REAL(R_y);
+   const int *positions = INTEGER(R_positions);
+   int n = LENGTH(R_y), count = LENGTH(R_positions);
+   double cutoff = REAL(R_cutoff)[0], tol = REAL(R_tol)[0];
+   int maxIterations = INTEGER(R_maxIterations)[0];
+   int k;
+   double *columns[6];
+   int *lower, *upper, *iterations, *converged;
+   SEXP ans, ans_names;
+
+   if (LENGTH(R_x) != n)
+      Rf_error( "x and y must have the same length");
+   for (k = 0; k < count; k++)
+      if (positions[k] == NA_INTEGER || positions[k] < 1 || positions[k] > n)
+         Rf_error( "Positions must be indices of y");
+   PROTECT(ans = allocVector(VECSXP, 11));
+   PROTECT(ans_names = allocVector(STRSXP, 11));
+   for (k = 0; k < 11; k++) {
+      SET_VECTOR_ELT(ans, k, allocVector(types[k], count));
+      SET_STRING_ELT(ans_names, k, mkChar(names[k]));
+   }
+   for (k = 0; k < 6; k++)
+      columns[k] = REAL(VECTOR_ELT(ans, k + 1));
+   lower = INTEGER(VECTOR_ELT(ans, 7));
+   upper = INTEGER(VECTOR_ELT(ans, 8));
+   iterations = INTEGER(VECTOR_ELT(ans, 9));
+   converged = LOGICAL(VECTOR_ELT(ans, 10));
+   for (k = 0; k < count; k++)
+      INTEGER(VECTOR_ELT(ans, 0))[k] = positions[k];
+//every peak is fitted independently, the windows are only read
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(SpectrumThreads(INTEGER(R_threads)[0])) schedule(dynamic)
+#endif
+   for (k = 0; k < count; k++) {
+      double start[3], par[3], se[3];
+      int j, first, last;
+      const char *error = SpectrumFitPeak(x, y, n, positions[k] - 1, cutoff,
+                                          start, par, se, &first, &last,
+                                          &iterations[k], maxIterations,
+                                          tol);
+      for (j = 0; j < 3; j++) {
+         columns[j][k] = error == 0 ? par[j] : NA_REAL;
+         columns[j + 3][k] = error == 0 ? se[j] : NA_REAL;
+      }
+      lower[k] = first + 1;
+      upper[k] = last + 1;
+      converged[k] = error == 0;
+   }
+   setAttrib(ans, R_NamesSymbol, ans_names);
+   UNPROTECT(2);
+   return ans;
+}
+
+static int BatchComparePeaks(const void *a, const void *b)
+{
+//peaks (channel, number) in the order of the channels
+   const int *pa = (const int *) a, *pb = (const int *) b;
+   if (pa[0] != pb[0])
+      return pa[0] < pb[0] ? -1 : 1;
+   return pa[1] < pb[1] ? -1 : pa[1] > pb[1];
+}
+
+SEXP R_SpectrumFitMultiplets(SEXP R_x, SEXP R_y, SEXP R_background,
+                             SEXP R_positions, SEXP R_cutoff, SEXP R_order,
+                             SEXP R_maxIterations, SEXP R_tol,
+                             SEXP R_threads)
+{
+/////////////////////////////////////////////////////////////////////////////
+//        JOINT GAUSSIAN FITS OF OVERLAPPING PEAKS OF A SPECTRUM
+//
+//        R_x,R_y-numeric vectors of the spectrum
+//        R_background-NULL, or numeric vector of an estimate of the
+//                     background of y, subtracted from y to find the
+//                     windows and the start values of the peaks
+//        R_positions-integer vector of the channels of the peaks (1-based)
+//        R_cutoff-fraction of the height of a peak above the background
+//                 bounding its window
+//        R_order-terms of the background polynomial of every multiplet
+//                (0 none, 1 constant, 2 linear, 3 quadratic)
+//        R_maxIterations,R_tol-see SpectrumFitGaussian
+//        R_threads-number of threads, NA for all processors
+//
+//        The peaks whose windows (as of FitAllPeaks) overlap form a
+//        multiplet, fitted by SpectrumFitMultiplet over the union of
+//        their windows. The multiplets are distributed over the threads.
+//        Returns a list of the list of vectors of the peaks (in the
+//        order of R_positions) and of the list of vectors of the
+//        multiplets. The estimates of a multiplet whose fit fails are NA.
+//
+/////////////////////////////////////////////////////////////////////////////
+   static const char *peakNames[] = {"position", "cluster", "mu", "sigma",
+                                     "height", "mu_se", "sigma_se",
+                                     "height_se", "background", "converged"};
+   static const SEXPTYPE peakTypes[] = {INTSXP, INTSXP, REALSXP, REALSXP,
+                                        REALSXP, REALSXP, REALSXP, REALSXP,
+                                        REALSXP, LGLSXP};
+   static const char *clusterNames[] = {"cluster", "lower", "upper",
+                                        "peaks", "center", "b0", "b1",
+                                        "b2", "iterations", "rss",
+                                        "converged"};
+   static const SEXPTYPE clusterTypes[] = {INTSXP, INTSXP, INTSXP, INTSXP,
+                                           REALSXP, REALSXP, REALSXP,
+                                           REALSXP, INTSXP, REALSXP,
+                                           LGLSXP};
+   const double *x = REAL(R_x), *y = REAL(R_y), *background = NULL, *net = y;
+   const int *positions = INTEGER(R_positions);
+   int n = LENGTH(R_y), count = LENGTH(R_positions);
+   double cutoff = REAL(R_cutoff)[0], tol = REAL(R_tol)[0];
+   double *difference;
+   int order = INTEGER(R_order)[0];
+   int maxIterations = INTEGER(R_maxIterations)[0];
+   int k, c, clusters, *sorted, *lower, *upper, *begin, *from, *to;
+   double *start, *peak[7], *cluster[5];
+   int *peakCluster, *peakConverged, *clusterInt[5], *clusterConverged;
+   const char *message = 0;
+   int failed = 0;
+   SEXP ans, ans_names, peaks, peaks_names, multiplets, multiplets_names;
+
+   if (LENGTH(R_x) != n)
+      Rf_error( "x and y must have the same length");
+   if (order < 0 || order > 3)
+      Rf_error( "Wrong Parameters");
+   for (k = 0; k < count; k++)
+      if (positions[k] == NA_INTEGER || positions[k] < 1 || positions[k] > n)
+         Rf_error( "Positions must be indices of y");
+   if (R_background != R_NilValue) {
+      if (LENGTH(R_background) != n)
+         Rf_error( "Background must have the length of y");
+      background = REAL(R_background);
+      difference = (double *) R_alloc(n, sizeof(double));
+      for (k = 0; k < n; k++)
+         difference[k] = y[k] - background[k];
+      net = difference;
+   }
+//peaks in the order of the channels with their windows and start values
+   sorted = (int *) R_alloc(2 * (size_t) count, sizeof(int));
+   lower = (int *) R_alloc(count, sizeof(int));
+   upper = (int *) R_alloc(count, sizeof(int));
+   start = (double *) R_alloc(3 * (size_t) count, sizeof(double));
+   for (k = 0; k < count; k++)
+      sorted[2 * k] = positions[k] - 1, sorted[2 * k + 1] = k;
+   qsort(sorted, count, 2 * sizeof(int), BatchComparePeaks);
+   for (k = 0; k < count; k++)
+      SpectrumPeakStart(x, net, n, sorted[2 * k], cutoff, start + 3 * k,
+                        lower + k, upper + k);
+//multiplets: runs of peaks whose windows overlap the ones before, the
+//window of a multiplet the union of theirs
+   begin = (int *) R_alloc((size_t) count + 1, sizeof(int));
+   from = (int *) R_alloc((size_t) count, sizeof(int));
+   to = (int *) R_alloc((size_t) count, sizeof(int));
+   for (k = 0, clusters = 0; k < count; k++) {
+      if (k == 0 || lower[k] > to[clusters - 1]) {
+         begin[clusters] = k;
+         from[clusters] = lower[k];
+         to[clusters++] = upper[k];
+      }
+
+      else {
+         if (lower[k] < from[clusters - 1])
+            from[clusters - 1] = lower[k];
+         if (upper[k] > to[clusters - 1])
+            to[clusters - 1] = upper[k];
+      }
+   }
+   begin[clusters] = count;
+
+   PROTECT(peaks = allocVector(VECSXP, 10));
+   PROTECT(peaks_names = allocVector(STRSXP, 10));
+   for (k = 0; k < 10; k++) {
+      SET_VECTOR_ELT(peaks, k, allocVector(peakTypes[k], count));
+      SET_STRING_ELT(peaks_names, k, mkChar(peakNames[k]));
+   }
+   setAttrib(peaks, R_NamesSymbol, peaks_names);
+   PROTECT(multiplets = allocVector(VECSXP, 11));
+   PROTECT(multiplets_names = allocVector(STRSXP, 11));
+   for (k = 0; k < 11; k++) {
+      SET_VECTOR_ELT(multiplets, k, allocVector(clusterTypes[k], clusters));
+      SET_STRING_ELT(multiplets_names, k, mkChar(clusterNames[k]));
+   }
+   setAttrib(multiplets, R_NamesSymbol, multiplets_names);
+   peakCluster = INTEGER(VECTOR_ELT(peaks, 1));
+   for (k = 0; k < 7; k++)
+      peak[k] = REAL(VECTOR_ELT(peaks, k + 2));
+   peakConverged = LOGICAL(VECTOR_ELT(peaks, 9));
+   for (k = 0; k < 4; k++)
+      clusterInt[k] = INTEGER(VECTOR_ELT(multiplets, k));
+   clusterInt[4] = INTEGER(VECTOR_ELT(multiplets, 8));
+   for (k = 0; k < 4; k++)
+      cluster[k] = REAL(VECTOR_ELT(multiplets, k + 4));
+   cluster[4] = REAL(VECTOR_ELT(multiplets, 9));
+   clusterConverged = LOGICAL(VECTOR_ELT(multiplets, 10));
+   for (k = 0; k < count; k++)
+      INTEGER(VECTOR_ELT(peaks, 0))[k] = positions[k];
+
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(SpectrumThreads(INTEGER(R_threads)[0])) schedule(dynamic)
+#endif
+   for (c = 0; c < clusters; c++) {
+      int first = begin[c], npeaks = begin[c + 1] - first;
+      int left = from[c], right = to[c];
+      int p = 3 * npeaks + order, j, i, m, iterations = 0;
+      size_t mark = SpectrumWorkspaceMark();
+      double *par = SpectrumWorkspaceAlloc(2 * (size_t) p), *se = par + p;
+      double center = (x[left] + x[right]) / 2;
+      double scale = (x[right] - x[left]) / 2;
+      double rss = NA_REAL, t, b = 0, cap, power;
+      const double *ends = background != NULL ? background : y;
+      const char *error = 0;
+      if (!(scale != 0))
+         scale = 1;
+      if (par == NULL)
+         error = "Not enough memory for working space";
+      else {
+//background through the ends of the window, the peaks above it
+         if (order >= 1)
+            par[3 * npeaks] = order == 1 ? (ends[left] < ends[right] ? ends[left] : ends[right]) : (ends[left] + ends[right]) / 2;
+         if (order >= 2)
+            par[3 * npeaks + 1] = (ends[right] - ends[left]) / 2;
+         if (order == 3)
+            par[3 * npeaks + 2] = 0;
+         for (j = 0; j < npeaks; j++) {
+            for (i = 0; i < 3; i++)
+               par[3 * j + i] = start[3 * (first + j) + i];
+            t = (par[3 * j] - center) / scale;
+            for (i = 0, b = 0, power = 1; i < order; i++, power *= t)
+               b += par[3 * npeaks + i] * power;
+            if (background == NULL && par[3 * j + 2] - b > 0)
+               par[3 * j + 2] -= b;
+//a start sigma not wider than half the distance to the neighbours
+            cap = INFINITY;
+            if (j > 0)
+               cap = fabs(par[3 * j] - start[3 * (first + j - 1)]) / 2;
+            if (j < npeaks - 1 && fabs(start[3 * (first + j + 1)] - par[3 * j]) / 2 < cap)
+               cap = fabs(start[3 * (first + j + 1)] - par[3 * j]) / 2;
+            if (cap > 0 && fabs(par[3 * j + 1]) > cap)
+               par[3 * j + 1] = cap;
+         }
+         error = SpectrumFitMultiplet(x + left, y + left, right - left + 1,
+                                      npeaks, order, par, se, &rss,
+                                      &iterations, maxIterations, tol);
+      }
+      for (j = 0; j < npeaks; j++) {
+         m = sorted[2 * (first + j) + 1];
+         peakCluster[m] = c + 1;
+         for (i = 0; i < 3; i++) {
+            peak[i][m] = error == 0 ? par[3 * j + i] : NA_REAL;
+            peak[i + 3][m] = error == 0 ? se[3 * j + i] : NA_REAL;
+         }
+         if (error == 0) {
+            t = (par[3 * j] - center) / scale;
+            for (i = 0, b = 0, power = 1; i < order; i++, power *= t)
+               b += par[3 * npeaks + i] * power;
+         }
+         peak[6][m] = error == 0 ? b : NA_REAL;
+         peakConverged[m] = error == 0;
+      }
+      clusterInt[0][c] = c + 1;
+      clusterInt[1][c] = left + 1;
+      clusterInt[2][c] = right + 1;
+      clusterInt[3][c] = npeaks;
+      clusterInt[4][c] = iterations;
+      cluster[0][c] = center;
+//coefficients of the powers of x-center
+      for (i = 0, power = 1; i < 3; i++, power *= scale)
+         cluster[i + 1][c] = error == 0 && i < order ? par[3 * npeaks + i] / power : NA_REAL;
+      cluster[4][c] = error == 0 ? rss : NA_REAL;
+      clusterConverged[c] = error == 0;
+      SpectrumWorkspaceRelease(mark);
+      if (par == NULL) {
+#ifdef _OPENMP
+#pragma omp critical(rPeaksBatchError)
+#endif
+         message = error;
+#ifdef _OPENMP
+#pragma omp atomic write
+#endif
+         failed = 1;
+      }
+   }
+   SpectrumWorkspaceReset();
+   if (failed)
+      Rf_error( "%s", message);
+   PROTECT(ans = allocVector(VECSXP, 2));
+   PROTECT(ans_names = allocVector(STRSXP, 2));
+   SET_VECTOR_ELT(ans, 0, peaks);
+   SET_VECTOR_ELT(ans, 1, multiplets);
+   SET_STRING_ELT(ans_names, 0, mkChar("peaks"));
+   SET_STRING_ELT(ans_names, 1, mkChar("clusters"));
+   setAttrib(ans, R_NamesSymbol, ans_names);
+   UNPROTECT(6);
+   return ans;
+}
@@ -0,0 +1,364 @@
+//__________________________________________________________________________
+//   FFT ENGINES OF THE ONE-DIMENSIONAL DECONVOLUTION FUNCTIONS            //
+//                                                                         //
+//   The Gold deconvolution needs the autocorrelation of the response      //
+//   (vector at*a), the cross-correlation of the response with the source  //
+//   (vector at*y) and in every iteration the convolution of the solution  //
+//   with the symmetric at*a kernel. The Richardson-Lucy deconvolution     //
+//   needs in every iteration the forward model h*x and the correlation    //
+//   of the ratio y/(h*x) with the response. Evaluated directly they cost  //
+//   O(ssize*lh_gold) each; here they are evaluated by the real FFT in     //
+//   O(n log n). The iterations themselves are those of the direct         //
+//   engines.                                                              //
+//____________________________________________________________________________
+
+#include <math.h>
+#include <string.h>
+
+#include "spectrum.h"
+
+const char *SpectrumResponseFFT(SpectrumResponse *prepared)
+{
+/////////////////////////////////////////////////////////////////////////////
+//   Completes a prepared response for the FFT engine: the spectrum of     //
+//   the response, the vector at*a (by the FFT, truncated to lags below    //
+//   lh_gold) and the spectrum of the symmetric at*a kernel.               //
+//   prepared->response, lh_gold, ssize and n must be set, spectrum,       //
+//   kernel and ata must point to n, n and lh_gold doubles.                //
+/////////////////////////////////////////////////////////////////////////////
+   int j, n = prepared->n, lh_gold = prepared->lh_gold;
+   double *buffer, *spectrum = prepared->spectrum, *kernel = prepared->kernel;
+   SpectrumFFT fft;
+   size_t mark = SpectrumWorkspaceMark();
+
+   buffer = SpectrumWorkspaceAlloc(n);
+   if (buffer == NULL || SpectrumFFTInit(&fft, n) != 0) {
+      SpectrumWorkspaceRelease(mark);
+      return "Not enough memory for working space";
+   }
+
+//spectrum of the response
+   memset(spectrum, 0, n * sizeof(double));
+   memcpy(spectrum, prepared->response, lh_gold * sizeof(double));
+   SpectrumFFTForward(&fft, spectrum);
+
+//vector at*a = autocorrelation of the response, zero for lags >= lh_gold
+   memcpy(buffer, spectrum, n * sizeof(double));
+   SpectrumFFTMultiply(buffer, spectrum, n, 1);
+   SpectrumFFTInverse(&fft, buffer);
+   for (j = 0; j < lh_gold; j++)
+      prepared->ata[j] = buffer[j];
+
+//symmetric convolution kernel at*a(|j|), -lh_gold < j < lh_gold
+   memset(kernel, 0, n * sizeof(double));
+   kernel[0] = prepared->ata[0];
+   for (j = 1; j < lh_gold; j++)
+      kernel[j] = kernel[n - j] = prepared->ata[j];
+   SpectrumFFTForward(&fft, kernel);
+   SpectrumWorkspaceRelease(mark);
+   return 0;
+}
+
+const char *SpectrumDeconvolutionGoldFFT(double *working_space,
+                                         const double *source,
+                                         const SpectrumResponse *prepared,
+                                         int numberIterations,
+                                         int numberRepetitions, double boost,
+                                         SpectrumConvergence *conv,
+                                         SpectrumAcceleration *acc)
+{
+/////////////////////////////////////////////////////////////////////////////
+//   working_space layout (as in the direct engine):                       //
+//   [0, ssize)           initial solution on input, resulting vector on   //
+//                        output                                           //
+//   [ssize, 2*ssize)     not used, at*a is applied as prepared->kernel    //
+//   [2*ssize, 3*ssize)   vector at*y                                      //
+//   [3*ssize, 4*ssize)   result of the current iteration                  //
+/////////////////////////////////////////////////////////////////////////////
+   int i, n = prepared->n, ssize = prepared->ssize, lindex, repet, stop;
+   double lda, ldb;
+   double *buffer;
+   SpectrumFFT fft;
+   size_t mark = SpectrumWorkspaceMark();
+
+   buffer = SpectrumWorkspaceAlloc(n);
+   if (buffer == NULL || SpectrumFFTInit(&fft, n) != 0) {
+      SpectrumWorkspaceRelease(mark);
+      return "Not enough memory for working space";
+   }
+
+//vector at*y = correlation of the response with the source
+   memset(buffer, 0, n * sizeof(double));
+   memcpy(buffer, source, ssize * sizeof(double));
+   SpectrumFFTForward(&fft, buffer);
+   SpectrumFFTMultiply(buffer, prepared->spectrum, n, 1);
+   SpectrumFFTInverse(&fft, buffer);
+   for (i = 0; i < ssize; i++) {
+      working_space[2 * ssize + i] = buffer[i];
+      working_space[3 * ssize + i] = buffer[i];
+//channels started at 0 are not updated and keep their value
+      if (working_space[i] <= 0.000001)
+         working_space[3 * ssize + i] = working_space[i];
+   }
+
+       //**START OF ITERATIONS**
+   for (repet = 0; repet < numberRepetitions; repet++) {
+      if (repet != 0) {
+         for (i = 0; i < ssize; i++)
+            working_space[i] = pow(working_space[i], boost);
+      }
+      if (acc != NULL)
+         SpectrumAccelerationStart(acc, working_space);
+      for (lindex = 0; lindex < numberIterations; lindex++) {
+         memcpy(buffer, working_space, ssize * sizeof(double));
+         memset(buffer + ssize, 0, (n - ssize) * sizeof(double));
+         SpectrumFFTForward(&fft, buffer);
+         SpectrumFFTMultiply(buffer, prepared->kernel, n, 0);
+         SpectrumFFTInverse(&fft, buffer);
+         for (i = 0; i < ssize; i++) {
+            if (working_space[2 * ssize + i] > 0.000001
+                 && working_space[i] > 0.000001) {
+               lda = buffer[i];
+               ldb = working_space[2 * ssize + i];
+               if (lda != 0)
+                  lda = ldb / lda;
+
+               else
+                  lda = 0;
+               ldb = working_space[i];
+               lda = lda * ldb;
+               working_space[3 * ssize + i] = lda;
+            }
+         }
+         stop = SpectrumIterationNext(conv, acc, repet, lindex,
+                                      lindex == numberIterations - 1,
+                                      working_space,
+                                      working_space + 3 * ssize, ssize);
+         if (stop)
+            break;
+      }
+   }
+   SpectrumWorkspaceRelease(mark);
+   return 0;
+}
+
+const char *SpectrumDeconvolutionRLFFT(double *working_space, int ssize,
+                                       int lh_gold, int numberIterations,
+                                       int numberRepetitions, double boost,
+                                       SpectrumConvergence *conv,
+                                       SpectrumAcceleration *acc)
+{
+/////////////////////////////////////////////////////////////////////////////
+//   working_space layout (as in the direct engine):                       //
+//   [0, ssize)           resulting vector, zero above ssize-lh_gold       //
+//   [ssize, 2*ssize)     response                                         //
+//   [2*ssize, 3*ssize)   source                                           //
+//   [3*ssize, 4*ssize)   result of the current iteration                  //
+//   [4*ssize, 5*ssize)   ratio y/(h*x)                                    //
+//                                                                         //
+//   The forward model h*x is a convolution and the back projection a      //
+//   correlation with the response, both of length ssize, so there is no  //
+//   wrap around in a transform of length >= ssize. Values of h*x below    //
+//   the rounding noise of the transform are treated as zero, like the     //
+//   non-positive ones in the direct engine.                               //
+/////////////////////////////////////////////////////////////////////////////
+   int i, j, n, lindex, repet, stop;
+   double lda, ldb, ldc, noise;
+   double *kernel, *buffer;
+   SpectrumFFT fft;
+   size_t mark = SpectrumWorkspaceMark();
+
+   n = SpectrumFFTSize(ssize);
+   kernel = SpectrumWorkspaceAlloc(n);
+   buffer = SpectrumWorkspaceAlloc(n);
+   if (kernel == NULL || buffer == NULL || SpectrumFFTInit(&fft, n) != 0) {
+      SpectrumWorkspaceRelease(mark);
+      return "Not enough memory for working space";
+   }
+
+//spectrum of the response
+   memset(kernel, 0, n * sizeof(double));
+   memcpy(kernel, working_space + ssize, lh_gold * sizeof(double));
+   SpectrumFFTForward(&fft, kernel);
+
+       //**START OF ITERATIONS**
+   for (repet = 0; repet < numberRepetitions; repet++) {
+      if (repet != 0) {
+         for (i = 0; i < ssize; i++)
+            working_space[i] = pow(working_space[i], boost);
+      }
+      if (acc != NULL)
+         SpectrumAccelerationStart(acc, working_space);
+      for (lindex = 0; lindex < numberIterations; lindex++) {
+//forward model h*x
+         memcpy(buffer, working_space, ssize * sizeof(double));
+         memset(buffer + ssize, 0, (n - ssize) * sizeof(double));
+         SpectrumFFTForward(&fft, buffer);
+         SpectrumFFTMultiply(buffer, kernel, n, 0);
+         SpectrumFFTInverse(&fft, buffer);
+         for (j = 0, noise = 0; j < ssize; j++) {
+            if (noise < fabs(buffer[j]))
+               noise = fabs(buffer[j]);
+         }
+         noise *= 1e-13;
+//ratio y/(h*x)
+         for (j = 0; j < ssize; j++) {
+            ldb = working_space[2 * ssize + j];//y[j]
+            if (ldb > 0) {
+               ldc = buffer[j];
+               if (ldc > noise)
+                  ldb = ldb / ldc;
+
+               else
+                  ldb = 0;
+            }
+            working_space[4 * ssize + j] = ldb;
+         }
+//back projection, correlation of the ratio with the response
+         memcpy(buffer, working_space + 4 * ssize, ssize * sizeof(double));
+         memset(buffer + ssize, 0, (n - ssize) * sizeof(double));
+         SpectrumFFTForward(&fft, buffer);
+         SpectrumFFTMultiply(buffer, kernel, n, 1);
+         SpectrumFFTInverse(&fft, buffer);
+         for (i = 0; i <= ssize - lh_gold; i++) {
+            lda = 0;
+            if (working_space[i] > 0)
+               lda = buffer[i] * working_space[i];
+            working_space[3 * ssize + i] = lda;
+         }
+         stop = SpectrumIterationNext(conv, acc, repet, lindex,
+                                      lindex == numberIterations - 1,
+                                      working_space,
+                                      working_space + 3 * ssize, ssize);
+         if (stop)
+            break;
+      }
+   }
+   SpectrumWorkspaceRelease(mark);
+   return 0;
+}
+
+int SpectrumConvergenceUpdate(SpectrumConvergence *conv, int repet,
+                              int lindex, const double *previous,
+                              const double *current, int ssize)
+{
+/////////////////////////////////////////////////////////////////////////////
+//   Records iteration lindex of repetition repet of a deconvolution, the  //
+//   relative change sum|current-previous| / sum|current| of the solution, //
+//   and returns nonzero when it is below the tolerance, i.e. when the     //
+//   repetition can be stopped. conv may be NULL.                          //
+/////////////////////////////////////////////////////////////////////////////
+   int i;
+   double change = 0, norm = 0;
+   if (conv == NULL)
+      return 0;
+   for (i = 0; i < ssize; i++) {
+      change += fabs(current[i] - previous[i]);
+      norm += fabs(current[i]);
+   }
+   if (norm > 0)
+      change /= norm;
+   if (conv->iterations != NULL)
+      conv->iterations[repet] = lindex + 1;
+   if (conv->change != NULL)
+      conv->change[repet] = change;
+   return conv->tol > 0 && change < conv->tol;
+}
+
+int SpectrumAccelerationInit(SpectrumAcceleration *acc, int ssize)
+{
+/////////////////////////////////////////////////////////////////////////////
+//   Takes the two vectors of the extrapolation from the arena of the      //
+//   calling thread. Returns 0 or -1 when out of memory.                   //
+/////////////////////////////////////////////////////////////////////////////
+   acc->ssize = ssize;
+   acc->count = 0;
+   acc->previous = SpectrumWorkspaceAlloc(ssize);
+   acc->step = SpectrumWorkspaceAlloc(ssize);
+   if (acc->previous == NULL || acc->step == NULL)
+      return -1;
+   return 0;
+}
+
+void SpectrumDeconvolutionStart(double *point, const double *init, int ssize,
+                                int posit, double scale)
+{
+/////////////////////////////////////////////////////////////////////////////
+//   Initial solution of a deconvolution: 1 in every channel, or the       //
+//   solution whose result (shifted by posit and multiplied by scale, as  //
+//   the functions write it back) is init.                                 //
+/////////////////////////////////////////////////////////////////////////////
+   int i;
+   for (i = 0; i < ssize; i++)
+      point[i] = init != NULL ? init[(i + posit) % ssize] / scale : 1;
+}
+
+void SpectrumAccelerationStart(SpectrumAcceleration *acc, const double *point)
+{
+/////////////////////////////////////////////////////////////////////////////
+//   Starts a repetition at point. The first iteration is not              //
+//   extrapolated, as there is no correction to compare with yet.         //
+/////////////////////////////////////////////////////////////////////////////
+   memcpy(acc->previous, point, acc->ssize * sizeof(double));
+   acc->count = 0;
+}
+
+int SpectrumIterationNext(SpectrumConvergence *conv,
+                          SpectrumAcceleration *acc, int repet, int lindex,
+                          int last, double *point, double *result,
+                          int ssize)
+{
+/////////////////////////////////////////////////////////////////////////////
+//   Ends iteration lindex of repetition repet, which has mapped point to  //
+//   result, and writes to point where the next iteration starts.         //
+//   Without acceleration (acc NULL) this is result itself. Otherwise,    //
+//   with the correction g = result - point of this iteration and h of    //
+//   the previous one, the solution is extrapolated as                     //
+//                                                                         //
+//      point = result + alpha * (result - previous),                      //
+//      alpha = sum(g*h) / sum(h*h), limited to [0, 0.95],                 //
+//                                                                         //
+//   previous being the result of the previous iteration. The last        //
+//   iteration of a repetition (last, or converged) is not extrapolated,  //
+//   so that point holds a solution of the unaccelerated update.          //
+//   The extrapolated point is also written to result, where it stays     //
+//   for the channels the next iteration does not update.                 //
+//   The convergence is measured between the results of two iterations.  //
+/////////////////////////////////////////////////////////////////////////////
+   int i, stop;
+   double alpha, lda, ldb, ldc;
+   stop = SpectrumConvergenceUpdate(conv, repet, lindex,
+                                    acc != NULL ? acc->previous : point,
+                                    result, ssize);
+   if (acc == NULL || stop || last) {
+      for (i = 0; i < ssize; i++)
+         point[i] = result[i];
+      return stop;
+   }
+   alpha = 0;
+   if (acc->count > 0) {
+      lda = 0, ldb = 0;
+      for (i = 0; i < ssize; i++) {
+         ldc = result[i] - point[i];
+         lda += ldc * acc->step[i];
+         ldb += acc->step[i] * acc->step[i];
+      }
+      if (ldb > 0)
+         alpha = lda / ldb;
+      if (alpha < 0)
+         alpha = 0;
+      if (alpha > 0.95)
+         alpha = 0.95;
+   }
+   for (i = 0; i < ssize; i++) {
+      acc->step[i] = result[i] - point[i];
+      lda = result[i] + alpha * (result[i] - acc->previous[i]);
+      if (lda < 0)
+         lda = result[i];
+      acc->previous[i] = result[i];
+      point[i] = lda;
+      result[i] = lda;
+   }
+   acc->count++;
+   return stop;
+}
@@ -0,0 +1,170 @@
+//__________________________________________________________________________
+//   REAL FAST FOURIER TRANSFORM                                           //
+//                                                                         //
+//   Self-contained radix-2 transform used by the FFT engines of the       //
+//   deconvolution functions. A real vector of length n (a power of two)   //
+//   is transformed by a complex transform of length n/2 followed by the   //
+//   usual split step. The half spectrum is stored in place in the packed  //
+//   format                                                                //
+//                                                                         //
+//      x[0] = Re X(0), x[1] = Re X(n/2),                                  //
+//      x[2k] = Re X(k), x[2k+1] = Im X(k)   for 0 < k < n/2               //
+//                                                                         //
+//   and the inverse transform includes the 1/n scaling, so that the       //
+//   inverse of the forward transform restores the input.                  //
+//____________________________________________________________________________
+
+#include <math.h>
+
+#include "spectrum.h"
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+int SpectrumFFTSize(int n)
+{
+   int size = 4;
+   while (size < n)
+      size *= 2;
+   return size;
+}
+
+int SpectrumFFTInit(SpectrumFFT *fft, int n)
+{
+/////////////////////////////////////////////////////////////////////////////
+//        Prepares the transform of length n (power of two, at least 4).
+//        The twiddle factors exp(-2*pi*i*k/n), k < n/2, are taken from
+//        the working space arena of the calling thread.
+//        Returns 0 on success, -1 when there is not enough memory.
+/////////////////////////////////////////////////////////////////////////////
+   int k;
+   double phi;
+   fft->n = n;
+   fft->twiddle = SpectrumWorkspaceAlloc(n);
+   if (fft->twiddle == NULL)
+      return -1;
+   for (k = 0; k < n / 2; k++) {
+      phi = 2 * M_PI * k / n;
+      fft->twiddle[2 * k] = cos(phi);
+      fft->twiddle[2 * k + 1] = -sin(phi);
+   }
+   return 0;
+}
+
+static void FFTComplex(const SpectrumFFT *fft, double *a, int inverse)
+{
+//in place complex transform of length m = n/2, a holds (re, im) pairs
+   int m = fft->n / 2, i, j, k, len, half, step, bit;
+   double wr, wi, ur, ui, vr, vi, sign = inverse ? -1 : 1;
+   const double *tw = fft->twiddle;
+   for (i = 1, j = 0; i < m; i++) {
+      for (bit = m >> 1; j & bit; bit >>= 1)
+         j ^= bit;
+      j ^= bit;
+      if (i < j) {
+         ur = a[2 * i], ui = a[2 * i + 1];
+         a[2 * i] = a[2 * j], a[2 * i + 1] = a[2 * j + 1];
+         a[2 * j] = ur, a[2 * j + 1] = ui;
+      }
+   }
+   for (len = 2; len <= m; len *= 2) {
+      half = len / 2;
+      step = 2 * (m / len);
+      for (k = 0; k < half; k++) {
+         wr = tw[2 * k * step];
+         wi = sign * tw[2 * k * step + 1];
+         for (i = k; i < m; i += len) {
+            j = i + half;
+            vr = a[2 * j] * wr - a[2 * j + 1] * wi;
+            vi = a[2 * j] * wi + a[2 * j + 1] * wr;
+            ur = a[2 * i], ui = a[2 * i + 1];
+            a[2 * i] = ur + vr, a[2 * i + 1] = ui + vi;
+            a[2 * j] = ur - vr, a[2 * j + 1] = ui - vi;
+         }
+      }
+   }
+}
+
+void SpectrumFFTForward(const SpectrumFFT *fft, double *x)
+{
+   int n = fft->n, m = n / 2, k;
+   double er, ei, or_, oi, wr, wi, tr, ti, a, b;
+   const double *tw = fft->twiddle;
+   FFTComplex(fft, x, 0);
+   a = x[0], b = x[1];
+   x[0] = a + b;
+   x[1] = a - b;
+   for (k = 1; k <= m / 2; k++) {
+      //E = (Z(k) + conj Z(m-k)) / 2, O = -i (Z(k) - conj Z(m-k)) / 2
+      er = (x[2 * k] + x[2 * (m - k)]) / 2;
+      ei = (x[2 * k + 1] - x[2 * (m - k) + 1]) / 2;
+      or_ = (x[2 * k + 1] + x[2 * (m - k) + 1]) / 2;
+      oi = -(x[2 * k] - x[2 * (m - k)]) / 2;
+      wr = tw[2 * k], wi = tw[2 * k + 1];
+      tr = wr * or_ - wi * oi;
+      ti = wr * oi + wi * or_;
+      //X(k) = E + W O, X(m-k) = conj(E - W O)
+      x[2 * k] = er + tr;
+      x[2 * k + 1] = ei + ti;
+      x[2 * (m - k)] = er - tr;
+      x[2 * (m - k) + 1] = -(ei - ti);
+   }
+}
+
+void SpectrumFFTInverse(const SpectrumFFT *fft, double *x)
+{
+   int n = fft->n, m = n / 2, k;
+   double er, ei, dr, di, or_, oi, wr, wi, a, b, scale = 1.0 / m;
+   const double *tw = fft->twiddle;
+   a = x[0], b = x[1];
+   x[0] = (a + b) / 2;
+   x[1] = (a - b) / 2;
+   for (k = 1; k <= m / 2; k++) {
+      //E = (X(k) + conj X(m-k)) / 2, O = (X(k) - conj X(m-k)) conj(W) / 2
+      er = (x[2 * k] + x[2 * (m - k)]) / 2;
+      ei = (x[2 * k + 1] - x[2 * (m - k) + 1]) / 2;
+      dr = (x[2 * k] - x[2 * (m - k)]) / 2;
+      di = (x[2 * k + 1] + x[2 * (m - k) + 1]) / 2;
+      wr = tw[2 * k], wi = -tw[2 * k + 1];
+      or_ = dr * wr - di * wi;
+      oi = dr * wi + di * wr;
+      //Z(k) = E + i O, Z(m-k) = conj(E - i O)
+      x[2 * k] = er - oi;
+      x[2 * k + 1] = ei + or_;
+      x[2 * (m - k)] = er + oi;
+      x[2 * (m - k) + 1] = -(ei - or_);
+   }
+   FFTComplex(fft, x, 1);
+   for (k = 0; k < n; k++)
+      x[k] *= scale;
+}
+
+void SpectrumFFTMultiply(double *x, const double *y, int n, int conjugate)
+{
+//x = x * y (or x * conj(y)) for two half spectra in the packed format
+   int k;
+   double xr, xi, yr, yi;
+   x[0] *= y[0];
+   x[1] *= y[1];
+   for (k = 1; k < n / 2; k++) {
+      xr = x[2 * k], xi = x[2 * k + 1];
+      yr = y[2 * k], yi = conjugate ? -y[2 * k + 1] : y[2 * k + 1];
+      x[2 * k] = xr * yr - xi * yi;
+      x[2 * k + 1] = xr * yi + xi * yr;
+   }
+}
+
+int SpectrumFFTPreferred(int ssize, int lh_gold)
+{
+/////////////////////////////////////////////////////////////////////////////
+//        Crossover of the automatic engine selection. One iteration of
+//        the direct engines costs about ssize*lh_gold multiply-adds, the
+//        FFT engine two transforms of length n plus the spectrum product;
+//        measured, both are equal at about ssize*lh_gold = n*log2(n).
+/////////////////////////////////////////////////////////////////////////////
+   int n = SpectrumFFTSize(ssize + lh_gold), logn = 0;
+   while ((1 << logn) < n)
+      logn++;
+   return (double) ssize * lh_gold > (double) n * logn;
+}
@@ -0,0 +1,614 @@
+//__________________________________________________________________________
+//   LEAST SQUARES FITTING OF PEAKS                                        //
+//                                                                         //
+//   A Gaussian scale*exp(-0.5*(x-mu)^2/sigma^2) is fitted to the points  //
+//   of a peak by the Levenberg-Marquardt method with the analytic        //
+//   derivatives of the model. The fit stops by the relative offset       //
+//   criterion of nls() (Bates and Watts), so it converges where nls()    //
+//   converges and gives the same estimates; their standard errors are    //
+//   those of summary(nls). Overlapping peaks are fitted together on a    //
+//   polynomial background; their normal equations are banded and are     //
+//   factored within their profile.                                        //
+//____________________________________________________________________________
+
+#include <math.h>
+
+#include <R.h>
+#include <Rinternals.h>
+
+#include "spectrum.h"
+
+#define FIT_PARAMETERS 3          //mu, sigma, scale
+#define FIT_LAMBDA_MAX 1e10       //damping of a step which cannot descend
+#define FIT_SUPPORT 8             //sigmas beyond which a peak is left out
+
+//residual sum of squares of a model at par and, unless a is NULL, the
+//normal equations a=J'J (full matrix) and g=J'r; NAN if par is invalid
+typedef double (*FitNormal)(const void *model, const double *par,
+                            double *a, double *g);
+
+static void FitGaussianPoint(const double *par, double x, double *f,
+                             double *gradient)
+{
+//value of the model at x and its derivatives by mu, sigma and scale
+   double u = (x - par[0]) / par[1], e = exp(-0.5 * u * u);
+   *f = par[2] * e;
+   if (gradient != NULL) {
+      gradient[0] = *f * u / par[1];
+      gradient[1] = *f * u * u / par[1];
+      gradient[2] = e;
+   }
+}
+
+typedef struct {
+   const double *x, *y;           //points of the peak
+   int n;
+} FitGaussianModel;
+
+static double FitGaussianNormal(const void *model, const double *par,
+                                double *a, double *g)
+{
+//FitNormal of one Gaussian
+   const FitGaussianModel *m = (const FitGaussianModel *) model;
+   int i, j, k;
+   double f, r, rss = 0, gradient[FIT_PARAMETERS];
+   if (par[1] == 0)
+      return NAN;
+   if (a != NULL)
+      for (j = 0; j < FIT_PARAMETERS; j++) {
+         g[j] = 0;
+         for (k = 0; k < FIT_PARAMETERS; k++)
+            a[j * FIT_PARAMETERS + k] = 0;
+      }
+   for (i = 0; i < m->n; i++) {
+      FitGaussianPoint(par, m->x[i], &f, a != NULL ? gradient : NULL);
+      r = m->y[i] - f;
+      rss += r * r;
+      if (a == NULL)
+         continue;
+      for (j = 0; j < FIT_PARAMETERS; j++) {
+         g[j] += gradient[j] * r;
+         for (k = 0; k <= j; k++)
+            a[j * FIT_PARAMETERS + k] += gradient[j] * gradient[k];
+      }
+   }
+   if (a != NULL)
+      for (j = 0; j < FIT_PARAMETERS; j++)
+         for (k = 0; k < j; k++)
+            a[k * FIT_PARAMETERS + j] = a[j * FIT_PARAMETERS + k];
+   return rss;
+}
+
+int SpectrumCholesky(double *a, int p, const int *first)
+{
+/////////////////////////////////////////////////////////////////////////////
+//        Cholesky factor L (lower triangle, a=LL') of the symmetric p x p
+//        matrix a in place; nonzero if a is not positive definite.
+//        first-NULL, or the column of the first nonzero element of every
+//              row of a (its profile): the factor has the same profile,
+//              elements outside it are neither read nor written.
+/////////////////////////////////////////////////////////////////////////////
+   int i, j, k, k0;
+   double s;
+   for (j = 0; j < p; j++) {
+      k0 = first != NULL ? first[j] : 0;
+      s = a[j * p + j];
+      for (k = k0; k < j; k++)
+         s -= a[j * p + k] * a[j * p + k];
+      if (!(s > 0))
+         return -1;
+      a[j * p + j] = sqrt(s);
+      for (i = j + 1; i < p; i++) {
+         if (first != NULL && first[i] > j)
+            continue;
+         s = a[i * p + j];
+         for (k = first != NULL && first[i] > k0 ? first[i] : k0; k < j; k++)
+            s -= a[i * p + k] * a[j * p + k];
+         a[i * p + j] = s / a[j * p + j];
+      }
+   }
+   return 0;
+}
+
+void SpectrumCholeskySolve(const double *l, int p, const int *first,
+                           double *b)
+{
+//solves LL'x=b in place for the factor (and profile) of SpectrumCholesky
+   int i, k;
+   for (i = 0; i < p; i++) {
+      for (k = first != NULL ? first[i] : 0; k < i; k++)
+         b[i] -= l[i * p + k] * b[k];
+      b[i] /= l[i * p + i];
+   }
+   for (i = p - 1; i >= 0; i--) {
+      for (k = i + 1; k < p; k++)
+         if (first == NULL || first[k] <= i)
+            b[i] -= l[k * p + i] * b[k];
+      b[i] /= l[i * p + i];
+   }
+}
+
+static void FitProfile(const double *a, int p, int *first)
+{
+//profile of the lower triangle of a for SpectrumCholesky
+   int i, k;
+   for (i = 0; i < p; i++) {
+      for (k = 0; k < i && a[i * p + k] == 0; k++)
+         ;
+      first[i] = k;
+   }
+}
+
+static const char *FitLevenbergMarquardt(FitNormal normal,
+                                         const void *model, int n, int p,
+                                         double *par, double *se,
+                                         double *rss, int *iterations,
+                                         int maxIterations, double tol,
+                                         double *work, int *first)
+{
+/////////////////////////////////////////////////////////////////////////////
+//   LEVENBERG-MARQUARDT FIT OF A MODEL
+//
+//   Function parameters:
+//        normal,model-the model, n points and p parameters
+//        par-start values on input, the estimates on return
+//        se-vector of the standard errors of the estimates, or NULL
+//        rss-where the residual sum of squares is stored, or NULL
+//        iterations-where the number of iterations is stored, or NULL
+//        maxIterations-maximal number of iterations
+//        tol-tolerance of the relative offset criterion of nls()
+//        work-2*p*p+3*p doubles
+//        first-p integers, the profile of J'J
+//
+//        Returns 0 or an error message (the estimates are those of the
+//        last iteration then).
+//
+/////////////////////////////////////////////////////////////////////////////
+   int i, j, iter = 0;
+   double *a = work, *l = a + (size_t) p * p, *g = l + (size_t) p * p;
+   double *step = g + p, *trial = step + p;
+   double q, lambda = 1e-3, s, t;
+   const char *message = 0;
+   if (n <= p || maxIterations < 0 || !(tol > 0))
+      return "Wrong Parameters";
+   s = normal(model, par, a, g);
+   if (ISNAN(s))
+      return "Wrong Parameters";
+   for (;;) {
+//relative offset: projection of the residuals on the tangent plane
+      FitProfile(a, p, first);
+      for (i = 0; i < p * p; i++)
+         l[i] = a[i];
+      if (SpectrumCholesky(l, p, first) != 0) {
+         message = "Singular gradient";
+         break;
+      }
+      for (i = 0; i < p; i++)
+         step[i] = g[i];
+      SpectrumCholeskySolve(l, p, first, step);
+      for (i = 0, q = 0; i < p; i++)
+         q += g[i] * step[i];
+      if (s == 0 || (s > q && sqrt(q / p / ((s - q) / (n - p))) < tol))
+         break;
+      if (iter == maxIterations) {
+         message = "Number of iterations exceeded maximum";
+         break;
+      }
+      iter += 1;
+//damped step, the damping raised until the residuals drop
+      for (;;) {
+         for (i = 0; i < p * p; i++)
+            l[i] = a[i];
+         for (i = 0; i < p; i++) {
+            l[i * p + i] *= 1 + lambda;
+            step[i] = g[i];
+         }
+         if (SpectrumCholesky(l, p, first) == 0) {
+            SpectrumCholeskySolve(l, p, first, step);
+            for (i = 0; i < p; i++)
+               trial[i] = par[i] + step[i];
+            t = normal(model, trial, NULL, NULL);
+            if (t <= s)
+               break;
+         }
+         lambda *= 10;
+         if (lambda > FIT_LAMBDA_MAX) {
+            message = "Step factor reduced below minimum";
+            break;
+         }
+      }
+      if (message != 0)
+         break;
+      lambda = lambda / 10 > 1e-12 ? lambda / 10 : 1e-12;
+      for (i = 0; i < p; i++)
+         par[i] = trial[i];
+      s = normal(model, par, a, g);
+   }
+   if (rss != NULL)
+      *rss = s;
+   if (iterations != NULL)
+      *iterations = iter;
+//standard errors from the diagonal of (J'J)^-1
+   if (se != NULL) {
+      FitProfile(a, p, first);
+      for (i = 0; i < p * p; i++)
+         l[i] = a[i];
+      if (SpectrumCholesky(l, p, first) != 0) {
+         for (i = 0; i < p; i++)
+            se[i] = NAN;
+         return message != 0 ? message : "Singular gradient";
+      }
+      for (i = 0; i < p; i++) {
+         for (j = 0; j < p; j++)
+            step[j] = i == j;
+         SpectrumCholeskySolve(l, p, first, step);
+         se[i] = sqrt(step[i] * s / (n - p));
+      }
+   }
+   return message;
+}
+
+const char *SpectrumFitGaussian(const double *x, const double *y, int n,
+                                double *par, double *se, double *rss,
+                                int *iterations, int maxIterations,
+                                double tol)
+{
+/////////////////////////////////////////////////////////////////////////////
+//   GAUSSIAN FIT OF A PEAK
+//
+//   Function parameters:
+//        x,y-vectors of the n points of the peak
+//        par-start values of mu, sigma and scale on input, their
+//            estimates on return
+//        se-vector of the standard errors of the estimates, or NULL
+//        rss-where the residual sum of squares is stored, or NULL
+//        iterations-where the number of iterations is stored, or NULL
+//        maxIterations-maximal number of iterations
+//        tol-tolerance of the relative offset criterion of nls()
+//
+//        The function does not call R, so it can run in any thread; it
+//        returns 0 or an error message (the estimates are those of the
+//        last iteration then).
+//
+/////////////////////////////////////////////////////////////////////////////
+   FitGaussianModel model;
+   double work[2 * FIT_PARAMETERS * FIT_PARAMETERS + 3 * FIT_PARAMETERS];
+   int first[FIT_PARAMETERS];
+   if (!(par[1] != 0))
+      return "Invalid sigma, must not be 0";
+   model.x = x, model.y = y, model.n = n;
+   return FitLevenbergMarquardt(FitGaussianNormal, &model, n,
+                                FIT_PARAMETERS, par, se, rss, iterations,
+                                maxIterations, tol, work, first);
+}
+
+static double FitCrossing(const double *x, const double *y, int n,
+                          int inner, int outer, double level)
+{
+//x where y crosses level between the channel inner at or above it and
+//its neighbour outer, linearly interpolated; x[inner] if outer is not
+//below level, NAN if it is not in the spectrum
+   if (outer < 0 || outer >= n)
+      return NAN;
+   if (!(y[outer] < level))
+      return x[inner];
+   return x[outer] + (level - y[outer]) / (y[inner] - y[outer]) * (x[inner] - x[outer]);
+}
+
+void SpectrumPeakWindow(const double *x, const double *y, int n, int i,
+                        double cutoff, SpectrumWindow *window)
+{
+/////////////////////////////////////////////////////////////////////////////
+//        Window of the peak at channel i, as EstimateGaussianParameters
+//        takes it: the channels around i down to cutoff times y[i] and
+//        the outermost channels in it at or above half of y[i]. The
+//        walk stops at the ends of y (the window is truncated then), so
+//        it takes at most the channels of the window and one more on
+//        each side.
+/////////////////////////////////////////////////////////////////////////////
+   double top = y[i], half = 0.5 * top, level = cutoff * top;
+   int j;
+   window->lowerHalf = window->upperHalf = i;
+   for (j = i; j > 0 && y[j - 1] >= level; j--)
+      if (y[j - 1] >= half)
+         window->lowerHalf = j - 1;
+   window->lower = j;
+   for (j = i; j < n - 1 && y[j + 1] >= level; j++)
+      if (y[j + 1] >= half)
+         window->upperHalf = j + 1;
+   window->upper = j;
+   window->truncated = window->lower == 0 || window->upper == n - 1;
+   window->left = FitCrossing(x, y, n, window->lowerHalf, window->lowerHalf - 1, half);
+   window->right = FitCrossing(x, y, n, window->upperHalf, window->upperHalf + 1, half);
+   window->leftCutoff = FitCrossing(x, y, n, window->lower, window->lower - 1, level);
+   window->rightCutoff = FitCrossing(x, y, n, window->upper, window->upper + 1, level);
+}
+
+static double FitWindowSigma(const SpectrumWindow *window, double x,
+                             double cutoff)
+{
+//FWHM/2.3548 of a window of the peak at x, a crossing outside the
+//spectrum mirrored from the other one; the width at the cutoff when it
+//is not wider than a channel at half height
+   double width = window->right - window->left;
+   if (ISNAN(window->left))
+      width = 2 * (window->right - x);
+   if (ISNAN(window->right))
+      width = 2 * (x - window->left);
+   if (!(width != 0) && cutoff > 0 && cutoff < 1) {
+      width = window->rightCutoff - window->leftCutoff;
+      if (ISNAN(window->leftCutoff))
+         width = 2 * (window->rightCutoff - x);
+      if (ISNAN(window->rightCutoff))
+         width = 2 * (x - window->leftCutoff);
+      return width / (2 * sqrt(-2 * log(cutoff)));
+   }
+   return width / 2.3548;
+}
+
+void SpectrumPeakStart(const double *x, const double *y, int n, int i,
+                       double cutoff, double *start, int *lower, int *upper)
+{
+/////////////////////////////////////////////////////////////////////////////
+//        Start values (mu, sigma, scale) of the Gaussian fit of the peak
+//        at channel i estimated as by EstimateGaussianParameters: its
+//        position, its FWHM/2.3548 and its height; lower and upper
+//        receive the window of SpectrumPeakWindow.
+/////////////////////////////////////////////////////////////////////////////
+   SpectrumWindow window;
+   SpectrumPeakWindow(x, y, n, i, cutoff, &window);
+   *lower = window.lower;
+   *upper = window.upper;
+   start[0] = x[i];
+   start[1] = FitWindowSigma(&window, x[i], cutoff);
+   start[2] = y[i];
+}
+
+const char *SpectrumFitPeak(const double *x, const double *y, int n, int i,
+                            double cutoff, double *start, double *par,
+                            double *se, int *lower, int *upper,
+                            int *iterations, int maxIterations, double tol)
+{
+/////////////////////////////////////////////////////////////////////////////
+//   GAUSSIAN FIT OF THE PEAK AT A CHANNEL
+//
+//   The steps of EstimateGaussianParameters and FitPeakToGaussian.
+//
+//   Function parameters:
+//        x,y-vectors of the n channels of the spectrum
+//        i-channel of the peak (0-based)
+//        cutoff-fraction of y[i] bounding the window fitted
+//        start-where the start values (mu, sigma, scale) are stored
+//        par,se-where the estimates and their standard errors are stored
+//        lower,upper-where the window (0-based, inclusive) is stored
+//        iterations,maxIterations,tol-see SpectrumFitGaussian
+//
+//        Returns 0 or an error message of SpectrumFitGaussian.
+//
+/////////////////////////////////////////////////////////////////////////////
+   SpectrumPeakStart(x, y, n, i, cutoff, start, lower, upper);
+   par[0] = start[0], par[1] = start[1], par[2] = start[2];
+   return SpectrumFitGaussian(x + *lower, y + *lower, *upper - *lower + 1,
+                              par, se, NULL, iterations, maxIterations, tol);
+}
+
+typedef struct {
+   const double *x, *y;           //points of the multiplet
+   int n;
+   int npeaks;                    //number of Gaussians
+   int order;                     //terms of the background polynomial
+   double center, scale;          //its variable is (x-center)/scale
+   int *index;                    //npeaks*3+order parameters a point
+   double *gradient;              //depends on and the derivatives
+} FitMultipletModel;
+
+static double FitMultipletNormal(const void *model, const double *par,
+                                 double *a, double *g)
+{
+/////////////////////////////////////////////////////////////////////////////
+//        FitNormal of a multiplet. A point depends on the Gaussians
+//        within FIT_SUPPORT sigmas of it and on the background, so J is
+//        sparse: J'J is accumulated over the nonzero derivatives of
+//        every point only, and with the peaks in the order of their
+//        positions it is banded with a border of the background terms.
+/////////////////////////////////////////////////////////////////////////////
+   const FitMultipletModel *m = (const FitMultipletModel *) model;
+   int p = 3 * m->npeaks + m->order, i, j, k, count;
+   double f, r, u, e, t, power, rss = 0;
+   for (j = 0; j < m->npeaks; j++)
+      if (par[3 * j + 1] == 0)
+         return NAN;
+   if (a != NULL)
+      for (j = 0; j < p; j++) {
+         g[j] = 0;
+         for (k = 0; k < p; k++)
+            a[j * p + k] = 0;
+      }
+   for (i = 0; i < m->n; i++) {
+      f = 0, count = 0;
+      for (j = 0; j < m->npeaks; j++) {
+         u = (m->x[i] - par[3 * j]) / par[3 * j + 1];
+         if (fabs(u) > FIT_SUPPORT)
+            continue;
+         e = exp(-0.5 * u * u);
+         f += par[3 * j + 2] * e;
+         m->index[count] = 3 * j;
+         m->gradient[count++] = par[3 * j + 2] * e * u / par[3 * j + 1];
+         m->index[count] = 3 * j + 1;
+         m->gradient[count++] = par[3 * j + 2] * e * u * u / par[3 * j + 1];
+         m->index[count] = 3 * j + 2;
+         m->gradient[count++] = e;
+      }
+      t = (m->x[i] - m->center) / m->scale;
+      for (k = 0, power = 1; k < m->order; k++, power *= t) {
+         f += par[3 * m->npeaks + k] * power;
+         m->index[count] = 3 * m->npeaks + k;
+         m->gradient[count++] = power;
+      }
+      r = m->y[i] - f;
+      rss += r * r;
+      if (a == NULL)
+         continue;
+//the indices of a point increase, so this fills the lower triangle
+      for (j = 0; j < count; j++) {
+         g[m->index[j]] += m->gradient[j] * r;
+         for (k = 0; k <= j; k++)
+            a[m->index[j] * p + m->index[k]] += m->gradient[j] * m->gradient[k];
+      }
+   }
+   if (a != NULL)
+      for (j = 0; j < p; j++)
+         for (k = 0; k < j; k++)
+            a[k * p + j] = a[j * p + k];
+   return rss;
+}
+
+const char *SpectrumFitMultiplet(const double *x, const double *y, int n,
+                                 int npeaks, int order, double *par,
+                                 double *se, double *rss, int *iterations,
+                                 int maxIterations, double tol)
+{
+/////////////////////////////////////////////////////////////////////////////
+//   FIT OF OVERLAPPING GAUSSIANS ON A POLYNOMIAL BACKGROUND
+//
+//   Function parameters:
+//        x,y-vectors of the n points of the multiplet
+//        npeaks-number of Gaussians, in increasing order of mu
+//        order-number of terms of the background (0 none, 1 constant,
+//              2 linear, 3 quadratic), a polynomial of (x-center)/scale
+//              with center and scale the middle and half width of x
+//        par-start values of mu, sigma and scale of every Gaussian
+//            followed by the coefficients of the background on input,
+//            the estimates on return
+//        se,rss,iterations,maxIterations,tol-see SpectrumFitGaussian
+//
+//        The working space is taken from the arena of the calling
+//        thread. The function does not call R, so it can run in any
+//        thread; it returns 0 or an error message.
+//
+/////////////////////////////////////////////////////////////////////////////
+   int p = 3 * npeaks + order;
+   size_t mark = SpectrumWorkspaceMark();
+   double *work;
+   FitMultipletModel model;
+   const char *message;
+   if (npeaks < 1 || order < 0 || order > 3)
+      return "Wrong Parameters";
+   model.x = x, model.y = y, model.n = n;
+   model.npeaks = npeaks, model.order = order;
+   model.center = (x[0] + x[n - 1]) / 2;
+   model.scale = (x[n - 1] - x[0]) / 2;
+   if (!(model.scale != 0))
+      model.scale = 1;
+   work = SpectrumWorkspaceAlloc(2 * (size_t) p * p + 4 * (size_t) p);
+//the integers of the arena, two per double
+   model.index = (int *) SpectrumWorkspaceAlloc((size_t) p);
+   if (work == NULL || model.index == NULL) {
+      SpectrumWorkspaceRelease(mark);
+      return "Not enough memory for working space";
+   }
+   model.gradient = work + 2 * (size_t) p * p + 3 * (size_t) p;
+   message = FitLevenbergMarquardt(FitMultipletNormal, &model, n, p, par,
+                                   se, rss, iterations, maxIterations, tol,
+                                   work, model.index + p);
+   SpectrumWorkspaceRelease(mark);
+   return message;
+}
+
+SEXP R_SpectrumPeakWindows(SEXP R_x, SEXP R_y, SEXP R_positions,
+                           SEXP R_cutoff)
+{
+/////////////////////////////////////////////////////////////////////////////
+//        WINDOWS OF PEAKS
+//
+//        R_x,R_y-numeric vectors of the spectrum
+//        R_positions-numeric vector of the positions of the peaks, 1-based
+//                    indices of y (fractional ones are rounded)
+//        R_cutoff-fraction of the height of a peak bounding its window
+//
+//        Returns a list of vectors, one element per peak, of the channel
+//        and the height taken, the window (1-based), the interpolated
+//        half height crossings (NA outside the spectrum) and sigma
+//        estimated from them.
+//
+/////////////////////////////////////////////////////////////////////////////
+   static const char *names[] = {"channel", "height", "lower", "upper",
+                                 "left", "right", "sigma", "truncated"};
+   static const SEXPTYPE types[] = {INTSXP, REALSXP, INTSXP, INTSXP,
+                                    REALSXP, REALSXP, REALSXP, LGLSXP};
+   const double *x = REAL(R_x), *y = REAL(R_y);
+   const double *positions = REAL(R_positions);
+   double cutoff = REAL(R_cutoff)[0];
+   int n = LENGTH(R_x), count = LENGTH(R_positions), i, k;
+   SpectrumWindow window;
+   SEXP ans, ans_names;
+
+   if (LENGTH(R_y) != n)
+      Rf_error( "x and y must have the same length");
+   PROTECT(ans = allocVector(VECSXP, 8));
+   PROTECT(ans_names = allocVector(STRSXP, 8));
+   for (k = 0; k < 8; k++) {
+      SET_VECTOR_ELT(ans, k, allocVector(types[k], count));
+      SET_STRING_ELT(ans_names, k, mkChar(names[k]));
+   }
+   for (k = 0; k < count; k++) {
+      if (!(positions[k] >= 0.5 && positions[k] < n + 0.5))
+         Rf_error( "Positions must be indices of y");
+      i = (int) floor(positions[k] + 0.5) - 1;
+      SpectrumPeakWindow(x, y, n, i, cutoff, &window);
+      INTEGER(VECTOR_ELT(ans, 0))[k] = i + 1;
+      REAL(VECTOR_ELT(ans, 1))[k] = y[i];
+      INTEGER(VECTOR_ELT(ans, 2))[k] = window.lower + 1;
+      INTEGER(VECTOR_ELT(ans, 3))[k] = window.upper + 1;
+      REAL(VECTOR_ELT(ans, 4))[k] = ISNAN(window.left) ? NA_REAL : window.left;
+      REAL(VECTOR_ELT(ans, 5))[k] = ISNAN(window.right) ? NA_REAL : window.right;
+      REAL(VECTOR_ELT(ans, 6))[k] = FitWindowSigma(&window, x[i], cutoff);
+      LOGICAL(VECTOR_ELT(ans, 7))[k] = window.truncated;
+   }
+   setAttrib(ans, R_NamesSymbol, ans_names);
+   UNPROTECT(2);
+   return ans;
+}
+
+SEXP R_SpectrumFitGaussian(SEXP R_x, SEXP R_y, SEXP R_start,
+                           SEXP R_maxIterations, SEXP R_tol)
+{
+/////////////////////////////////////////////////////////////////////////////
+//        Gaussian fit of the points (R_x, R_y) from the start values
+//        R_start (mu, sigma, scale). Returns a list of the estimates,
+//        their standard errors, the residual sum of squares and the
+//        number of iterations.
+/////////////////////////////////////////////////////////////////////////////
+   int n = LENGTH(R_x), iterations, i;
+   double par[FIT_PARAMETERS], se[FIT_PARAMETERS], rss;
+   const char *message;
+   SEXP estimate, stderror, ans, ans_names;
+   if (LENGTH(R_y) != n || LENGTH(R_start) != FIT_PARAMETERS)
+      Rf_error( "Wrong Parameters");
+   for (i = 0; i < FIT_PARAMETERS; i++)
+      par[i] = REAL(R_start)[i];
+   message = SpectrumFitGaussian(REAL(R_x), REAL(R_y), n, par, se, &rss,
+                                 &iterations, INTEGER(R_maxIterations)[0],
+                                 REAL(R_tol)[0]);
+   if (message != 0)
+      Rf_error( "%s", message);
+   PROTECT(estimate = allocVector(REALSXP, FIT_PARAMETERS));
+   PROTECT(stderror = allocVector(REALSXP, FIT_PARAMETERS));
+   for (i = 0; i < FIT_PARAMETERS; i++) {
+      REAL(estimate)[i] = par[i];
+      REAL(stderror)[i] = se[i];
+   }
+   PROTECT(ans = allocVector(VECSXP, 4));
+   PROTECT(ans_names = allocVector(STRSXP, 4));
+   SET_STRING_ELT(ans_names, 0, mkChar("estimate"));
+   SET_STRING_ELT(ans_names, 1, mkChar("se"));
+   SET_STRING_ELT(ans_names, 2, mkChar("rss"));
+   SET_STRING_ELT(ans_names, 3, mkChar("iterations"));
+   SET_VECTOR_ELT(ans, 0, estimate);
+   SET_VECTOR_ELT(ans, 1, stderror);
+   SET_VECTOR_ELT(ans, 2, ScalarReal(rss));
+   SET_VECTOR_ELT(ans, 3, ScalarInteger(iterations));
+   setAttrib(ans, R_NamesSymbol, ans_names);
+   UNPROTECT(4);
+   return ans;
+}
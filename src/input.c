@@ -0,0 +1,307 @@
+//__________________________________________________________________________
+//   SPECTRA OF THE .Call ENTRY POINTS                                     //
+//                                                                         //
+//   The entry points take a spectrum either as an R numeric vector or as //
+//   a flat binary file mapped into memory (float64, float32 or uint32    //
+//   channels in the byte order of the machine), which is handed to R as  //
+//   an external pointer with the tag and class "rPeaksMappedSpectrum".   //
+//   A float64 file is passed to the algorithms in place, the channels of //
+//   the other types (and of integer vectors) are converted into the      //
+//   arena of the calling thread; the single precision background takes   //
+//   a float32 file in place instead.                                      //
+//   A result can be written to a new float64 file mapped the same way    //
+//   instead of an R vector. The mapping is released by the finalizer     //
+//   when R collects the object.                                           //
+//____________________________________________________________________________
+
+#include <errno.h>
+#include <limits.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define INPUT_MMAP 1
+#endif
+
+#include <R.h>
+#include <Rinternals.h>
+
+#include "spectrum.h"
+
+typedef struct {
+   void *base;                    //begin of the mapping
+   size_t length;                 //bytes mapped
+   const void *data;              //first channel
+   int type;                      //kInputFloat64, kInputFloat32, kInputUInt32
+   int ssize;                     //number of channels
+#ifdef INPUT_MMAP
+   dev_t device;                  //the file mapped
+   ino_t inode;
+#endif
+} MappedSpectrum;
+
+static const char *InputTypes[] = {"float64", "float32", "uint32"};
+static const size_t InputSizes[] = {sizeof(double), sizeof(float),
+                                    sizeof(uint32_t)};
+
+static void MappedFinalizer(SEXP ptr)
+{
+   MappedSpectrum *mapped = (MappedSpectrum *) R_ExternalPtrAddr(ptr);
+   if (mapped == NULL)
+      return;
+#ifdef INPUT_MMAP
+   munmap(mapped->base, mapped->length);
+#endif
+   free(mapped);
+   R_ClearExternalPtr(ptr);
+}
+
+static SEXP MapFile(const char *path, int type, double offset, double count,
+                    int create)
+{
+/////////////////////////////////////////////////////////////////////////////
+//        MAPPING OF A SPECTRUM FILE
+//
+//        path-name of the file
+//        type-kInputFloat64, kInputFloat32 or kInputUInt32
+//        offset-bytes before the first channel, a multiple of the size
+//               of a channel
+//        count-number of channels, NA for all channels after offset
+//        create-TRUE to create (or truncate) the file with count float64
+//               channels and map it for writing
+//
+//        Returns the external pointer to the mapping.
+//
+/////////////////////////////////////////////////////////////////////////////
+#ifdef INPUT_MMAP
+   int fd;
+   size_t size, start, page;
+   struct stat st;
+   void *base;
+   MappedSpectrum *mapped;
+   SEXP ptr, cls, value;
+
+   if (type < kInputFloat64 || type > kInputUInt32)
+      Rf_error( "Unknown type of spectrum file");
+   size = InputSizes[type];
+   if (ISNAN(offset) || offset < 0 || offset != (double) (size_t) offset
+       || (size_t) offset % size != 0)
+      Rf_error( "Offset must be a multiple of %d bytes", (int) size);
+//the object is made first, so no allocation by R can lose the mapping
+   PROTECT(ptr = R_MakeExternalPtr(NULL, install("rPeaksMappedSpectrum"), R_NilValue));
+   R_RegisterCFinalizerEx(ptr, MappedFinalizer, TRUE);
+   PROTECT(cls = mkString("rPeaksMappedSpectrum"));
+   setAttrib(ptr, R_ClassSymbol, cls);
+   PROTECT(value = mkString(path));
+   setAttrib(ptr, install("path"), value);
+   PROTECT(value = mkString(InputTypes[type]));
+   setAttrib(ptr, install("type"), value);
+   if (create) {
+      fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0666);
+      if (fd < 0)
+         Rf_error( "Cannot create %s: %s", path, strerror(errno));
+      if (count < 1 || ftruncate(fd, (off_t) (count * size)) != 0) {
+         close(fd);
+         Rf_error( "Cannot create %s", path);
+      }
+   }
+
+   else{
+      fd = open(path, O_RDONLY);
+      if (fd < 0)
+         Rf_error( "Cannot open %s: %s", path, strerror(errno));
+   }
+   if (fstat(fd, &st) != 0) {
+      close(fd);
+      Rf_error( "Cannot open %s: %s", path, strerror(errno));
+   }
+   if (ISNAN(count))
+      count = offset < st.st_size ? floor((st.st_size - offset) / size) : 0;
+   if (count < 1 || count > INT_MAX || offset + count * size > st.st_size) {
+      close(fd);
+      Rf_error( "%s does not hold the requested channels", path);
+   }
+   page = (size_t) sysconf(_SC_PAGESIZE);
+   start = (size_t) offset / page * page;
+   size = (size_t) offset - start + (size_t) count * size;
+   base = mmap(NULL, size, create ? PROT_READ | PROT_WRITE : PROT_READ,
+               MAP_SHARED, fd, (off_t) start);
+   close(fd);
+   if (base == MAP_FAILED)
+      Rf_error( "Cannot map %s: %s", path, strerror(errno));
+   mapped = (MappedSpectrum *) malloc(sizeof(MappedSpectrum));
+   if (mapped == NULL) {
+      munmap(base, size);
+      Rf_error( "Not enough memory for mapped spectrum");
+   }
+   mapped->base = base;
+   mapped->length = size;
+   mapped->data = (const char *) base + ((size_t) offset - start);
+   mapped->type = type;
+   mapped->ssize = (int) count;
+   mapped->device = st.st_dev;
+   mapped->inode = st.st_ino;
+   R_SetExternalPtrAddr(ptr, mapped);
+   PROTECT(value = ScalarInteger(mapped->ssize));
+   setAttrib(ptr, install("channels"), value);
+   UNPROTECT(5);
+   return ptr;
+#else
+   Rf_error( "Mapped spectrum files are not supported on this platform");
+   return R_NilValue;
+#endif
+}
+
+SEXP R_SpectrumMapFile(SEXP R_path, SEXP R_type, SEXP R_offset,
+                       SEXP R_length)
+{
+/////////////////////////////////////////////////////////////////////////////
+//        READ-ONLY MAPPING OF A SPECTRUM FILE
+//
+//        R_path-name of the file
+//        R_type-kInputFloat64, kInputFloat32 or kInputUInt32
+//        R_offset-bytes before the first channel
+//        R_length-number of channels, NA for the rest of the file
+//
+//        Returns an external pointer to the mapping.
+//
+/////////////////////////////////////////////////////////////////////////////
+   return MapFile(translateChar(STRING_ELT(R_path, 0)), INTEGER(R_type)[0],
+                  REAL(R_offset)[0], REAL(R_length)[0], FALSE);
+}
+
+static MappedSpectrum *InputMapped(SEXP R_y)
+{
+//mapping of a spectrum passed from R, NULL if it is not a mapped file
+   MappedSpectrum *mapped;
+   if (TYPEOF(R_y) != EXTPTRSXP)
+      return NULL;
+   if (R_ExternalPtrTag(R_y) != install("rPeaksMappedSpectrum"))
+      Rf_error( "Not a spectrum");
+   mapped = (MappedSpectrum *) R_ExternalPtrAddr(R_y);
+   if (mapped == NULL)
+      Rf_error( "Mapped spectrum is no longer valid");
+   return mapped;
+}
+
+const double *SpectrumInput(SEXP R_y, int *ssize)
+{
+/////////////////////////////////////////////////////////////////////////////
+//        Channels of a spectrum passed from R, a numeric or integer vector
+//        or a mapped file, as doubles. Converted channels are taken from
+//        the arena, so call it after SpectrumWorkspaceReset.
+/////////////////////////////////////////////////////////////////////////////
+   MappedSpectrum *mapped = InputMapped(R_y);
+   double *values;
+   int i;
+   if (mapped == NULL && TYPEOF(R_y) == REALSXP) {
+      *ssize = LENGTH(R_y);
+      return REAL(R_y);
+   }
+   if (mapped != NULL && mapped->type == kInputFloat64) {
+      *ssize = mapped->ssize;
+      return (const double *) mapped->data;
+   }
+   if (mapped == NULL && TYPEOF(R_y) != INTSXP)
+      Rf_error( "Spectrum must be a numeric vector or a mapped spectrum file");
+   *ssize = mapped != NULL ? mapped->ssize : LENGTH(R_y);
+   values = SpectrumWorkspaceAlloc(*ssize);
+   if (values == NULL)
+      Rf_error( "Not enough memory for working space");
+   if (mapped == NULL)
+      for (i = 0; i < *ssize; i++)
+         values[i] = INTEGER(R_y)[i] == NA_INTEGER ? NA_REAL : INTEGER(R_y)[i];
+
+   else if (mapped->type == kInputFloat32)
+      for (i = 0; i < *ssize; i++)
+         values[i] = ((const float *) mapped->data)[i];
+
+   else
+      for (i = 0; i < *ssize; i++)
+         values[i] = ((const uint32_t *) mapped->data)[i];
+   return values;
+}
+
+const float *SpectrumInputSingle(SEXP R_y, int *ssize)
+{
+/////////////////////////////////////////////////////////////////////////////
+//        The same as SpectrumInput, the channels rounded to single
+//        precision. A mapped float32 file is used in place.
+/////////////////////////////////////////////////////////////////////////////
+   MappedSpectrum *mapped = InputMapped(R_y);
+   float *values;
+   int i;
+   if (mapped != NULL && mapped->type == kInputFloat32) {
+      *ssize = mapped->ssize;
+      return (const float *) mapped->data;
+   }
+   if (mapped == NULL && TYPEOF(R_y) != REALSXP && TYPEOF(R_y) != INTSXP)
+      Rf_error( "Spectrum must be a numeric vector or a mapped spectrum file");
+   *ssize = mapped != NULL ? mapped->ssize : LENGTH(R_y);
+//the arena hands out doubles, two floats each
+   values = (float *) SpectrumWorkspaceAlloc(((size_t) *ssize + 1) / 2);
+   if (values == NULL)
+      Rf_error( "Not enough memory for working space");
+   if (mapped == NULL && TYPEOF(R_y) == REALSXP)
+      for (i = 0; i < *ssize; i++)
+         values[i] = (float) REAL(R_y)[i];
+
+   else if (mapped == NULL)
+      for (i = 0; i < *ssize; i++)
+         values[i] = INTEGER(R_y)[i] == NA_INTEGER ? NAN : (float) INTEGER(R_y)[i];
+
+   else if (mapped->type == kInputFloat64)
+      for (i = 0; i < *ssize; i++)
+         values[i] = (float) ((const double *) mapped->data)[i];
+
+   else
+      for (i = 0; i < *ssize; i++)
+         values[i] = (float) ((const uint32_t *) mapped->data)[i];
+   return values;
+}
+
+static void OutputCheck(const char *path, SEXP R_y)
+{
+//refuses to create path over the mapped file of R_y, which the truncation
+//would empty under the algorithm reading it
+#ifdef INPUT_MMAP
+   MappedSpectrum *mapped = InputMapped(R_y);
+   struct stat st;
+   if (mapped != NULL && stat(path, &st) == 0 && st.st_dev == mapped->device
+       && st.st_ino == mapped->inode)
+      Rf_error( "%s is the file of the spectrum being processed", path);
+#endif
+}
+
+SEXP SpectrumOutput(SEXP R_output, int ssize, SEXP R_source, SEXP R_init)
+{
+/////////////////////////////////////////////////////////////////////////////
+//        Result of ssize channels: a new numeric vector when R_output is
+//        NULL, otherwise the file named by R_output created with ssize
+//        float64 channels and mapped for writing. R_source and R_init
+//        (R_NilValue if there is none) are the spectra the result is
+//        computed from; the file may not be one of theirs.
+/////////////////////////////////////////////////////////////////////////////
+   const char *path;
+   if (R_output == R_NilValue)
+      return allocVector(REALSXP, ssize);
+   if (ssize <= 0)
+      Rf_error( "Wrong Parameters");
+   path = translateChar(STRING_ELT(R_output, 0));
+   OutputCheck(path, R_source);
+   OutputCheck(path, R_init);
+   return MapFile(path, kInputFloat64, 0, ssize, TRUE);
+}
+
+double *SpectrumOutputData(SEXP f)
+{
+//channels of a result made by SpectrumOutput
+   if (TYPEOF(f) == EXTPTRSXP)
+      return (double *) ((MappedSpectrum *) R_ExternalPtrAddr(f))->data;
+   return REAL(f);
+}
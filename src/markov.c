@@ -0,0 +1,203 @@
+//__________________________________________________________________________
+//   TRANSITION TERMS OF THE MARKOV CHAIN SMOOTHING                        //
+//                                                                         //
+//   The Markov chain smoothing needs, for every channel j and every       //
+//   distance d within the averaging window, the term                      //
+//   exp((y(j+d)-y(j)) / sqrt(y(j+d)+y(j))). They are evaluated here for   //
+//   a channel and a range of distances at once, either with the           //
+//   exponential and square root of the C library or with vectorized      //
+//   approximations (AVX2 or SSE2, selected at run time, scalar           //
+//   elsewhere) of relative error below 1e-14.                             //
+//____________________________________________________________________________
+
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "spectrum.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define MARKOV_X86 1
+#include <immintrin.h>
+#endif
+
+//1.5*2^52, adding it rounds to an integer held in the low mantissa bits
+#define MARKOV_SHIFTER 6755399441055744.0
+
+static double MarkovPow2(double t)
+{
+//2^k for t = k + MARKOV_SHIFTER, -1022 <= k <= 1023
+   int64_t bits, shifter;
+   double shift = MARKOV_SHIFTER;
+   memcpy(&bits, &t, sizeof(double));
+   memcpy(&shifter, &shift, sizeof(double));
+   bits = (bits - shifter + 1023) << 52;
+   memcpy(&t, &bits, sizeof(double));
+   return t;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+//        scalar instance
+/////////////////////////////////////////////////////////////////////////////
+#define MARKOV_NAME(f) f ## Scalar
+#define MARKOV_TARGET
+#define MARKOV_VEC double
+#define MARKOV_WIDTH 1
+#define MARKOV_LOAD(p) (*(p))
+#define MARKOV_STORE(p, v) (*(p) = (v))
+#define MARKOV_SET(x) ((double) (x))
+#define MARKOV_ADD(x, y) ((x) + (y))
+#define MARKOV_SUB(x, y) ((x) - (y))
+#define MARKOV_MUL(x, y) ((x) * (y))
+#define MARKOV_DIV(x, y) ((x) / (y))
+#define MARKOV_RSQRT(x) (1 / sqrt(x))
+#define MARKOV_MAX(x, y) ((x) < (y) ? (y) : (x))
+#define MARKOV_MIN(x, y) ((x) > (y) ? (y) : (x))
+#define MARKOV_POSITIVE(s, v, w) ((s) > 0 ? (v) : (w))
+#define MARKOV_POW2(t) MarkovPow2(t)
+#include "markov_kernel.h"
+#undef MARKOV_NAME
+#undef MARKOV_TARGET
+#undef MARKOV_VEC
+#undef MARKOV_WIDTH
+#undef MARKOV_LOAD
+#undef MARKOV_STORE
+#undef MARKOV_SET
+#undef MARKOV_ADD
+#undef MARKOV_SUB
+#undef MARKOV_MUL
+#undef MARKOV_DIV
+#undef MARKOV_RSQRT
+#undef MARKOV_MAX
+#undef MARKOV_MIN
+#undef MARKOV_POSITIVE
+#undef MARKOV_POW2
+
+#ifdef MARKOV_X86
+/////////////////////////////////////////////////////////////////////////////
+//        SSE2 instance
+/////////////////////////////////////////////////////////////////////////////
+#define MARKOV_NAME(f) f ## SSE2
+#define MARKOV_TARGET __attribute__((target("sse2")))
+#define MARKOV_VEC __m128d
+#define MARKOV_WIDTH 2
+#define MARKOV_LOAD(p) _mm_loadu_pd(p)
+#define MARKOV_STORE(p, v) _mm_storeu_pd((p), (v))
+#define MARKOV_SET(x) _mm_set1_pd(x)
+#define MARKOV_ADD(x, y) _mm_add_pd((x), (y))
+#define MARKOV_SUB(x, y) _mm_sub_pd((x), (y))
+#define MARKOV_MUL(x, y) _mm_mul_pd((x), (y))
+#define MARKOV_DIV(x, y) _mm_div_pd((x), (y))
+#define MARKOV_RSQRT(x) _mm_cvtps_pd(_mm_rsqrt_ps(_mm_cvtpd_ps(x)))
+#define MARKOV_MAX(x, y) _mm_max_pd((x), (y))
+#define MARKOV_MIN(x, y) _mm_min_pd((x), (y))
+#define MARKOV_POSITIVE(s, v, w) _mm_or_pd(_mm_and_pd(_mm_cmpgt_pd((s), _mm_setzero_pd()), (v)), \
+                                           _mm_andnot_pd(_mm_cmpgt_pd((s), _mm_setzero_pd()), (w)))
+#define MARKOV_POW2(t) _mm_castsi128_pd(_mm_slli_epi64(_mm_add_epi64(_mm_sub_epi64( \
+                          _mm_castpd_si128(t), _mm_castpd_si128(shifter)), \
+                          _mm_set1_epi64x(1023)), 52))
+#include "markov_kernel.h"
+#undef MARKOV_NAME
+#undef MARKOV_TARGET
+#undef MARKOV_VEC
+#undef MARKOV_WIDTH
+#undef MARKOV_LOAD
+#undef MARKOV_STORE
+#undef MARKOV_SET
+#undef MARKOV_ADD
+#undef MARKOV_SUB
+#undef MARKOV_MUL
+#undef MARKOV_DIV
+#undef MARKOV_RSQRT
+#undef MARKOV_MAX
+#undef MARKOV_MIN
+#undef MARKOV_POSITIVE
+#undef MARKOV_POW2
+
+/////////////////////////////////////////////////////////////////////////////
+//        AVX2 instance
+/////////////////////////////////////////////////////////////////////////////
+#define MARKOV_NAME(f) f ## AVX2
+#define MARKOV_TARGET __attribute__((target("avx2")))
+#define MARKOV_VEC __m256d
+#define MARKOV_WIDTH 4
+#define MARKOV_LOAD(p) _mm256_loadu_pd(p)
+#define MARKOV_STORE(p, v) _mm256_storeu_pd((p), (v))
+#define MARKOV_SET(x) _mm256_set1_pd(x)
+#define MARKOV_ADD(x, y) _mm256_add_pd((x), (y))
+#define MARKOV_SUB(x, y) _mm256_sub_pd((x), (y))
+#define MARKOV_MUL(x, y) _mm256_mul_pd((x), (y))
+#define MARKOV_DIV(x, y) _mm256_div_pd((x), (y))
+#define MARKOV_RSQRT(x) _mm256_cvtps_pd(_mm_rsqrt_ps(_mm256_cvtpd_ps(x)))
+#define MARKOV_MAX(x, y) _mm256_max_pd((x), (y))
+#define MARKOV_MIN(x, y) _mm256_min_pd((x), (y))
+#define MARKOV_POSITIVE(s, v, w) _mm256_blendv_pd((w), (v), \
+                                    _mm256_cmp_pd((s), _mm256_setzero_pd(), _CMP_GT_OQ))
+#define MARKOV_POW2(t) _mm256_castsi256_pd(_mm256_slli_epi64(_mm256_add_epi64(_mm256_sub_epi64( \
+                          _mm256_castpd_si256(t), _mm256_castpd_si256(shifter)), \
+                          _mm256_set1_epi64x(1023)), 52))
+#include "markov_kernel.h"
+#undef MARKOV_NAME
+#undef MARKOV_TARGET
+#undef MARKOV_VEC
+#undef MARKOV_WIDTH
+#undef MARKOV_LOAD
+#undef MARKOV_STORE
+#undef MARKOV_SET
+#undef MARKOV_ADD
+#undef MARKOV_SUB
+#undef MARKOV_MUL
+#undef MARKOV_DIV
+#undef MARKOV_RSQRT
+#undef MARKOV_MAX
+#undef MARKOV_MIN
+#undef MARKOV_POSITIVE
+#undef MARKOV_POW2
+#endif
+
+void SpectrumMarkovPairs(const double *s, int j, int count, double *e,
+                         double *reciprocal, int precision)
+{
+/////////////////////////////////////////////////////////////////////////////
+//        TRANSITION TERMS OF CHANNEL j
+//
+//        Function parameters:
+//        s-spectrum divided by its maximum
+//        j-channel, s[j+count] must exist
+//        count-number of distances
+//        e-resulting terms, e[d-1] for distance d = 1..count:
+//          exp((s[j+d]-s[j]) / sqrt(s[j+d]+s[j])), the square root
+//          replaced by 1 where s[j+d]+s[j] <= 0
+//        reciprocal-resulting 1/e
+//        precision-kMarkovExact (functions of the C library) or
+//                  kMarkovFast (vectorized approximations)
+//
+/////////////////////////////////////////////////////////////////////////////
+   int d = 0;
+   double a, b;
+   if (precision == kMarkovFast) {
+#ifdef MARKOV_X86
+      switch (SpectrumInstructionSet()) {
+      case kInstructionAVX2:
+         d = MarkovPairsFastAVX2(s, j, 0, count, e, reciprocal);
+         break;
+      case kInstructionSSE2:
+         d = MarkovPairsFastSSE2(s, j, 0, count, e, reciprocal);
+         break;
+      }
+#endif
+      MarkovPairsFastScalar(s, j, d, count, e, reciprocal);
+      return;
+   }
+   for (d = 1; d <= count; d++) {
+      a = s[j + d];
+      b = a - s[j];
+      if (a + s[j] <= 0)
+         a = 1;
+
+      else
+         a = sqrt(a + s[j]);
+      e[d - 1] = exp(b / a);
+      reciprocal[d - 1] = 1 / e[d - 1];
+   }
+}
@@ -0,0 +1,76 @@
+//__________________________________________________________________________
+//   TRANSITION TERMS OF THE MARKOV CHAIN SMOOTHING                        //
+//                                                                         //
+//   This file is included by markov.c once for every instruction set.    //
+//   The includer defines the vector type and its width and the vector     //
+//   operations:                                                           //
+//                                                                         //
+//      MARKOV_NAME(f)          name of the instance of function f         //
+//      MARKOV_TARGET           function attribute selecting the target    //
+//      MARKOV_VEC              vector of doubles                          //
+//      MARKOV_WIDTH            number of elements in a vector             //
+//      MARKOV_LOAD, MARKOV_STORE unaligned load and store                 //
+//      MARKOV_SET(x)           all elements equal x                       //
+//      MARKOV_ADD, MARKOV_SUB, MARKOV_MUL, MARKOV_DIV                     //
+//      MARKOV_RSQRT(x)         approximation of 1/sqrt(x), x > 1e-30      //
+//      MARKOV_MAX, MARKOV_MIN  larger and smaller element                 //
+//      MARKOV_POSITIVE(s, v, w) s > 0 ? v : w                             //
+//      MARKOV_POW2(t)          2^k, t = k + MARKOV_SHIFTER                //
+//                                                                         //
+//   The approximation of 1/sqrt (about 12 bits) is refined by three      //
+//   Newton steps, so the terms of all instances agree to a few units of  //
+//   the last digit.                                                       //
+//____________________________________________________________________________
+
+static MARKOV_TARGET int MARKOV_NAME(MarkovPairsFast)(const double *s, int j,
+                                                      int from, int to,
+                                                      double *e,
+                                                      double *reciprocal)
+{
+//e[d] = exp((s[j+1+d]-s[j]) / sqrt(s[j+1+d]+s[j])) and reciprocal[d] =
+//1/e[d] for from <= d < to, the exponential evaluated as 2^k * exp(r),
+//|r| <= ln(2)/2, with exp(r) from its Taylor polynomial of degree 11
+   int d;
+   MARKOV_VEC a, b, x, t, k, r, p, sum, y;
+   const double *q = s + j + 1;
+   const MARKOV_VEC one = MARKOV_SET(1), half = MARKOV_SET(0.5),
+      threehalfs = MARKOV_SET(1.5), tiny = MARKOV_SET(1e-30),
+      lo = MARKOV_SET(-708),
+      hi = MARKOV_SET(708), log2e = MARKOV_SET(1.4426950408889634074),
+      ln2hi = MARKOV_SET(6.93147180369123816490e-01),
+      ln2lo = MARKOV_SET(1.90821492927058770002e-10),
+      shifter = MARKOV_SET(MARKOV_SHIFTER);
+   b = MARKOV_SET(s[j]);
+   for (d = from; d + MARKOV_WIDTH <= to; d += MARKOV_WIDTH) {
+      a = MARKOV_LOAD(q + d);
+      x = MARKOV_SUB(a, b);
+      sum = MARKOV_ADD(a, b);
+      y = MARKOV_MAX(sum, tiny);
+      r = MARKOV_MUL(half, y);
+      y = MARKOV_RSQRT(y);
+      y = MARKOV_MUL(y, MARKOV_SUB(threehalfs, MARKOV_MUL(r, MARKOV_MUL(y, y))));
+      y = MARKOV_MUL(y, MARKOV_SUB(threehalfs, MARKOV_MUL(r, MARKOV_MUL(y, y))));
+      y = MARKOV_MUL(y, MARKOV_SUB(threehalfs, MARKOV_MUL(r, MARKOV_MUL(y, y))));
+      x = MARKOV_MUL(x, MARKOV_POSITIVE(sum, y, one));
+      x = MARKOV_MIN(MARKOV_MAX(x, lo), hi);
+      t = MARKOV_ADD(MARKOV_MUL(x, log2e), shifter);
+      k = MARKOV_SUB(t, shifter);
+      r = MARKOV_SUB(MARKOV_SUB(x, MARKOV_MUL(k, ln2hi)), MARKOV_MUL(k, ln2lo));
+      p = MARKOV_SET(2.5052108385441718775e-08);
+      p = MARKOV_ADD(MARKOV_MUL(p, r), MARKOV_SET(2.7557319223985890653e-07));
+      p = MARKOV_ADD(MARKOV_MUL(p, r), MARKOV_SET(2.7557319223985890653e-06));
+      p = MARKOV_ADD(MARKOV_MUL(p, r), MARKOV_SET(2.4801587301587301587e-05));
+      p = MARKOV_ADD(MARKOV_MUL(p, r), MARKOV_SET(1.9841269841269841270e-04));
+      p = MARKOV_ADD(MARKOV_MUL(p, r), MARKOV_SET(1.3888888888888888889e-03));
+      p = MARKOV_ADD(MARKOV_MUL(p, r), MARKOV_SET(8.3333333333333333333e-03));
+      p = MARKOV_ADD(MARKOV_MUL(p, r), MARKOV_SET(4.1666666666666666667e-02));
+      p = MARKOV_ADD(MARKOV_MUL(p, r), MARKOV_SET(1.6666666666666666667e-01));
+      p = MARKOV_ADD(MARKOV_MUL(p, r), MARKOV_SET(0.5));
+      p = MARKOV_ADD(MARKOV_MUL(p, r), one);
+      p = MARKOV_ADD(MARKOV_MUL(p, r), one);
+      p = MARKOV_MUL(p, MARKOV_POW2(t));
+      MARKOV_STORE(e + d, p);
+      MARKOV_STORE(reciprocal + d, MARKOV_DIV(one, p));
+   }
+   return d;
+}
@@ -0,0 +1,246 @@
+//__________________________________________________________________________
+//   MOMENTS OF PEAK REGIONS                                               //
+//                                                                         //
+//   The weight (sum of y), the weighted mean of x and the weighted sum   //
+//   of squares of x about a mean over segments of a spectrum, in one     //
+//   pass. x is taken relative to the middle of the segment and every     //
+//   sum is compensated (Kahan), so the moments of a narrow peak far from //
+//   the origin of x keep their precision. The sums run in AVX2 or SSE2   //
+//   lanes, selected at run time as the SNIP kernels are, and a scalar    //
+//   version is used elsewhere; the lanes are added in a fixed order, so  //
+//   the result depends on the instruction set only by rounding.          //
+//____________________________________________________________________________
+
+#include <math.h>
+
+#include <R.h>
+#include <Rinternals.h>
+
+#include "spectrum.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define MOMENTS_X86 1
+#include <immintrin.h>
+#endif
+
+#define MOMENTS_BLOCK 256         //points of x transformed at a time
+
+static void MomentsAdd(double *sum, double *compensation, double value)
+{
+//Kahan summation
+   double y = value - *compensation, t = *sum + y;
+   *compensation = (t - *sum) - y;
+   *sum = t;
+}
+
+static void MomentsScalar(const double *x, const double *y, int n,
+                          double center, double *sum, double *compensation)
+{
+//sum[0..2] += y, y*u, y*u*u for u=x-center
+   int i;
+   double u, w;
+   for (i = 0; i < n; i++) {
+      u = x[i] - center, w = y[i];
+      MomentsAdd(&sum[0], &compensation[0], w);
+      MomentsAdd(&sum[1], &compensation[1], w * u);
+      MomentsAdd(&sum[2], &compensation[2], w * u * u);
+   }
+}
+
+#ifdef MOMENTS_X86
+static __attribute__((target("sse2"))) int
+MomentsSSE2(const double *x, const double *y, int n, double center,
+            double *sum, double *compensation)
+{
+//MomentsScalar in two lanes, the lanes added to sum; returns the points
+//done
+   __m128d s[3], c[3], v[3], t, u, w, m = _mm_set1_pd(center);
+   double lanes[2];
+   int i, k;
+   if (n < 2)
+      return 0;
+   for (k = 0; k < 3; k++)
+      s[k] = _mm_setzero_pd(), c[k] = _mm_setzero_pd();
+   for (i = 0; i + 2 <= n; i += 2) {
+      u = _mm_sub_pd(_mm_loadu_pd(x + i), m);
+      w = _mm_loadu_pd(y + i);
+      v[0] = w;
+      v[1] = _mm_mul_pd(w, u);
+      v[2] = _mm_mul_pd(v[1], u);
+      for (k = 0; k < 3; k++) {
+         v[k] = _mm_sub_pd(v[k], c[k]);
+         t = _mm_add_pd(s[k], v[k]);
+         c[k] = _mm_sub_pd(_mm_sub_pd(t, s[k]), v[k]);
+         s[k] = t;
+      }
+   }
+   for (k = 0; k < 3; k++) {
+      _mm_storeu_pd(lanes, s[k]);
+      MomentsAdd(&sum[k], &compensation[k], lanes[0]);
+      MomentsAdd(&sum[k], &compensation[k], lanes[1]);
+      _mm_storeu_pd(lanes, c[k]);
+      MomentsAdd(&sum[k], &compensation[k], -lanes[0]);
+      MomentsAdd(&sum[k], &compensation[k], -lanes[1]);
+   }
+   return i;
+}
+
+static __attribute__((target("avx2"))) int
+MomentsAVX2(const double *x, const double *y, int n, double center,
+            double *sum, double *compensation)
+{
+//MomentsScalar in four lanes, the lanes added to sum; returns the points
+//done
+   __m256d s[3], c[3], v[3], t, u, w, m = _mm256_set1_pd(center);
+   double lanes[4];
+   int i, j, k;
+   if (n < 4)
+      return 0;
+   for (k = 0; k < 3; k++)
+      s[k] = _mm256_setzero_pd(), c[k] = _mm256_setzero_pd();
+   for (i = 0; i + 4 <= n; i += 4) {
+      u = _mm256_sub_pd(_mm256_loadu_pd(x + i), m);
+      w = _mm256_loadu_pd(y + i);
+      v[0] = w;
+      v[1] = _mm256_mul_pd(w, u);
+      v[2] = _mm256_mul_pd(v[1], u);
+      for (k = 0; k < 3; k++) {
+         v[k] = _mm256_sub_pd(v[k], c[k]);
+         t = _mm256_add_pd(s[k], v[k]);
+         c[k] = _mm256_sub_pd(_mm256_sub_pd(t, s[k]), v[k]);
+         s[k] = t;
+      }
+   }
+   for (k = 0; k < 3; k++) {
+      _mm256_storeu_pd(lanes, s[k]);
+      for (j = 0; j < 4; j++)
+         MomentsAdd(&sum[k], &compensation[k], lanes[j]);
+      _mm256_storeu_pd(lanes, c[k]);
+      for (j = 0; j < 4; j++)
+         MomentsAdd(&sum[k], &compensation[k], -lanes[j]);
+   }
+   return i;
+}
+#endif
+
+static void MomentsBlock(const double *x, const double *y, int n,
+                         double center, double *sum, double *compensation)
+{
+//the sums of n points with the widest instruction set
+   int i = 0;
+#ifdef MOMENTS_X86
+   switch (SpectrumInstructionSet()) {
+   case kInstructionAVX2:
+      i = MomentsAVX2(x, y, n, center, sum, compensation);
+      break;
+   case kInstructionSSE2:
+      i = MomentsSSE2(x, y, n, center, sum, compensation);
+      break;
+   }
+#endif
+   MomentsScalar(x + i, y + i, n - i, center, sum, compensation);
+}
+
+void SpectrumMoments(const double *x, const double *y, int n,
+                     int logarithm, const double *mu, double *moments)
+{
+/////////////////////////////////////////////////////////////////////////////
+//   MOMENTS OF A SEGMENT
+//
+//   Function parameters:
+//        x,y-vectors of the n points of the segment
+//        logarithm-nonzero to take the moments of log(x)
+//        mu-mean about which the sum of squares is taken, or NULL for
+//           the weighted mean
+//        moments-where sum(y), sum(y*x)/sum(y) and sum(y*(x-mean)^2)
+//                are stored
+//
+//        The function does not call R, so it can run in any thread.
+//
+/////////////////////////////////////////////////////////////////////////////
+   double sum[3] = {0, 0, 0}, compensation[3] = {0, 0, 0};
+   double buffer[MOMENTS_BLOCK], center, m;
+   int i, j, count;
+   if (n <= 0) {
+      moments[0] = 0, moments[1] = NAN, moments[2] = NAN;
+      return;
+   }
+   center = logarithm ? log(x[n / 2]) : x[n / 2];
+   if (!logarithm)
+      MomentsBlock(x, y, n, center, sum, compensation);
+
+   else
+      for (i = 0; i < n; i += count) {
+         count = n - i < MOMENTS_BLOCK ? n - i : MOMENTS_BLOCK;
+         for (j = 0; j < count; j++)
+            buffer[j] = log(x[i + j]);
+         MomentsBlock(buffer, y + i, count, center, sum, compensation);
+      }
+   for (j = 0; j < 3; j++)
+      sum[j] -= compensation[j];
+   moments[0] = sum[0];
+   moments[1] = center + sum[1] / sum[0];
+//sum of y*(u-d)^2 for the mean at u=d
+   m = mu != NULL ? *mu - center : sum[1] / sum[0];
+   moments[2] = sum[2] - 2 * m * sum[1] + m * m * sum[0];
+}
+
+SEXP R_SpectrumMoments(SEXP R_x, SEXP R_y, SEXP R_from, SEXP R_to,
+                       SEXP R_logarithm, SEXP R_mu, SEXP R_threads)
+{
+/////////////////////////////////////////////////////////////////////////////
+//        MOMENTS OF SEGMENTS OF A SPECTRUM
+//
+//        R_x,R_y-numeric vectors of the spectrum
+//        R_from,R_to-integer vectors of the first and last points of the
+//                    segments (1-based)
+//        R_logarithm-nonzero for the moments of log(x)
+//        R_mu-NULL, or numeric vector of the means of the segments the
+//             sums of squares are taken about
+//        R_threads-number of threads, NA for all processors
+//
+//        Returns a list of the vectors sum, mean and sumsq.
+//
+/////////////////////////////////////////////////////////////////////////////
+   const double *x = REAL(R_x), *y = REAL(R_y);
+   const double *mu = R_mu != R_NilValue ? REAL(R_mu) : NULL;
+   const int *from = INTEGER(R_from), *to = INTEGER(R_to);
+   int n = LENGTH(R_x), count = LENGTH(R_from);
+   int logarithm = INTEGER(R_logarithm)[0], k;
+   double *sum, *mean, *sumsq;
+   SEXP ans, ans_names;
+
+   if (LENGTH(R_y) != n)
+      Rf_error( "x and y must have the same length");
+   if (LENGTH(R_to) != count || (mu != NULL && LENGTH(R_mu) != count))
+      Rf_error( "Wrong Parameters");
+   for (k = 0; k < count; k++)
+      if (from[k] == NA_INTEGER || to[k] == NA_INTEGER || from[k] < 1
+          || to[k] > n || to[k] < from[k] - 1)
+         Rf_error( "Segments must be ranges of indices of x");
+   PROTECT(ans = allocVector(VECSXP, 3));
+   PROTECT(ans_names = allocVector(STRSXP, 3));
+   SET_VECTOR_ELT(ans, 0, allocVector(REALSXP, count));
+   SET_VECTOR_ELT(ans, 1, allocVector(REALSXP, count));
+   SET_VECTOR_ELT(ans, 2, allocVector(REALSXP, count));
+   SET_STRING_ELT(ans_names, 0, mkChar("sum"));
+   SET_STRING_ELT(ans_names, 1, mkChar("mean"));
+   SET_STRING_ELT(ans_names, 2, mkChar("sumsq"));
+   sum = REAL(VECTOR_ELT(ans, 0));
+   mean = REAL(VECTOR_ELT(ans, 1));
+   sumsq = REAL(VECTOR_ELT(ans, 2));
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(SpectrumThreads(INTEGER(R_threads)[0])) schedule(dynamic, 64)
+#endif
+   for (k = 0; k < count; k++) {
+      double moments[3];
+      SpectrumMoments(x + from[k] - 1, y + from[k] - 1, to[k] - from[k] + 1,
+                      logarithm, mu != NULL ? mu + k : NULL, moments);
+      sum[k] = moments[0];
+      mean[k] = moments[1];
+      sumsq[k] = moments[2];
+   }
+   setAttrib(ans, R_NamesSymbol, ans_names);
+   UNPROTECT(2);
+   return ans;
+}
@@ -0,0 +1,62 @@
+//__________________________________________________________________________
+//   PREPARED RESPONSE OBJECTS                                             //
+//                                                                         //
+//   A response prepared by SpectrumResponsePrepare is handed to R as an  //
+//   external pointer with the tag and class "rPeaksResponse". Its memory //
+//   is released by the finalizer when R collects the object.             //
+//____________________________________________________________________________
+
+#include <stdlib.h>
+
+#include <R.h>
+#include <Rinternals.h>
+
+#include "spectrum.h"
+
+static void ResponseFinalizer(SEXP ptr)
+{
+   SpectrumResponse *prepared = (SpectrumResponse *) R_ExternalPtrAddr(ptr);
+   if (prepared == NULL)
+      return;
+   SpectrumResponseFree(prepared);
+   free(prepared);
+   R_ClearExternalPtr(ptr);
+}
+
+SEXP R_SpectrumPrepareResponse(SEXP R_response, SEXP R_engine)
+{
+/////////////////////////////////////////////////////////////////////////////
+//        PREPARED RESPONSE FOR THE GOLD DECONVOLUTION
+//
+//        R_response-response spectrum, of the length of the spectra to
+//                   be deconvolved
+//        R_engine-kEngineAuto, kEngineDirect or kEngineFFT
+//
+//        Returns an external pointer to the prepared response.
+//
+/////////////////////////////////////////////////////////////////////////////
+   int ssize = LENGTH(R_response);
+   int engine = INTEGER(R_engine)[0];
+   SpectrumResponse *prepared;
+   const char *message;
+   SEXP ptr, cls;
+
+//the object is made first, so no allocation by R can lose the block
+   PROTECT(ptr = R_MakeExternalPtr(NULL, install("rPeaksResponse"), R_NilValue));
+   R_RegisterCFinalizerEx(ptr, ResponseFinalizer, TRUE);
+   PROTECT(cls = mkString("rPeaksResponse"));
+   setAttrib(ptr, R_ClassSymbol, cls);
+   prepared = (SpectrumResponse *) malloc(sizeof(SpectrumResponse));
+   if (prepared == NULL)
+      Rf_error( "Not enough memory for prepared response");
+   SpectrumWorkspaceReset();
+   message = SpectrumResponsePrepare(prepared, REAL(R_response), ssize, engine);
+   SpectrumWorkspaceReset();
+   if (message != 0) {
+      free(prepared);
+      Rf_error( "%s", message);
+   }
+   R_SetExternalPtrAddr(ptr, prepared);
+   UNPROTECT(2);
+   return ptr;
+}
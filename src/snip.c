@@ -0,0 +1,401 @@
+//__________________________________________________________________________
+//   SNIP BACKGROUND CLIPPING KERNELS                                      //
+//                                                                         //
+//   One clipping pass of the SNIP algorithm (filters of order 2 to 8,     //
+//   optionally applied to box averages of the spectrum) vectorized with   //
+//   AVX2 or SSE2; the instruction set is selected at run time and a      //
+//   scalar version is used elsewhere. Every kernel exists in double and   //
+//   in single precision, which moves half the bytes per channel. The     //
+//   box averages of a pass are taken from prefix sums, so their cost     //
+//   does not depend on the width of the smoothing window nor on the       //
+//   number of filter taps.                                                //
+//____________________________________________________________________________
+
+#include <stddef.h>
+
+#include "spectrum.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define SNIP_X86 1
+#include <immintrin.h>
+#endif
+
+/////////////////////////////////////////////////////////////////////////////
+//        scalar instance
+/////////////////////////////////////////////////////////////////////////////
+#define SNIP_NAME(f) f ## Scalar
+#define SNIP_TARGET
+#define SNIP_REAL double
+#define SNIP_VEC double
+#define SNIP_WIDTH 1
+#define SNIP_LOAD(p) (*(p))
+#define SNIP_STORE(p, v) (*(p) = (v))
+#define SNIP_SET(x) ((double) (x))
+#define SNIP_ADD(x, y) ((x) + (y))
+#define SNIP_SUB(x, y) ((x) - (y))
+#define SNIP_MUL(x, y) ((x) * (y))
+#define SNIP_DIV(x, y) ((x) / (y))
+#define SNIP_NEG(x) (-(x))
+#define SNIP_MAX(b, e) ((b) < (e) ? (e) : (b))
+#define SNIP_MIN(b, a) ((b) < (a) ? (b) : (a))
+#define SNIP_SELECT(b, a, v) ((b) < (a) ? (b) : (v))
+#include "snip_kernel.h"
+#undef SNIP_NAME
+#undef SNIP_TARGET
+#undef SNIP_REAL
+#undef SNIP_VEC
+#undef SNIP_WIDTH
+#undef SNIP_LOAD
+#undef SNIP_STORE
+#undef SNIP_SET
+#undef SNIP_ADD
+#undef SNIP_SUB
+#undef SNIP_MUL
+#undef SNIP_DIV
+#undef SNIP_NEG
+#undef SNIP_MAX
+#undef SNIP_MIN
+#undef SNIP_SELECT
+
+/////////////////////////////////////////////////////////////////////////////
+//        scalar instance, single precision
+/////////////////////////////////////////////////////////////////////////////
+#define SNIP_NAME(f) f ## SingleScalar
+#define SNIP_TARGET
+#define SNIP_REAL float
+#define SNIP_VEC float
+#define SNIP_WIDTH 1
+#define SNIP_LOAD(p) (*(p))
+#define SNIP_STORE(p, v) (*(p) = (v))
+#define SNIP_SET(x) ((float) (x))
+#define SNIP_ADD(x, y) ((x) + (y))
+#define SNIP_SUB(x, y) ((x) - (y))
+#define SNIP_MUL(x, y) ((x) * (y))
+#define SNIP_DIV(x, y) ((x) / (y))
+#define SNIP_NEG(x) (-(x))
+#define SNIP_MAX(b, e) ((b) < (e) ? (e) : (b))
+#define SNIP_MIN(b, a) ((b) < (a) ? (b) : (a))
+#define SNIP_SELECT(b, a, v) ((b) < (a) ? (b) : (v))
+#include "snip_kernel.h"
+#undef SNIP_NAME
+#undef SNIP_TARGET
+#undef SNIP_REAL
+#undef SNIP_VEC
+#undef SNIP_WIDTH
+#undef SNIP_LOAD
+#undef SNIP_STORE
+#undef SNIP_SET
+#undef SNIP_ADD
+#undef SNIP_SUB
+#undef SNIP_MUL
+#undef SNIP_DIV
+#undef SNIP_NEG
+#undef SNIP_MAX
+#undef SNIP_MIN
+#undef SNIP_SELECT
+
+#ifdef SNIP_X86
+/////////////////////////////////////////////////////////////////////////////
+//        SSE2 instance
+/////////////////////////////////////////////////////////////////////////////
+#define SNIP_NAME(f) f ## SSE2
+#define SNIP_TARGET __attribute__((target("sse2")))
+#define SNIP_REAL double
+#define SNIP_VEC __m128d
+#define SNIP_WIDTH 2
+#define SNIP_LOAD(p) _mm_loadu_pd(p)
+#define SNIP_STORE(p, v) _mm_storeu_pd((p), (v))
+#define SNIP_SET(x) _mm_set1_pd(x)
+#define SNIP_ADD(x, y) _mm_add_pd((x), (y))
+#define SNIP_SUB(x, y) _mm_sub_pd((x), (y))
+#define SNIP_MUL(x, y) _mm_mul_pd((x), (y))
+#define SNIP_DIV(x, y) _mm_div_pd((x), (y))
+#define SNIP_NEG(x) _mm_xor_pd((x), _mm_set1_pd(-0.0))
+#define SNIP_MAX(b, e) _mm_max_pd((e), (b))
+#define SNIP_MIN(b, a) _mm_min_pd((b), (a))
+#define SNIP_SELECT(b, a, v) _mm_or_pd(_mm_and_pd(_mm_cmplt_pd((b), (a)), (b)), \
+                                       _mm_andnot_pd(_mm_cmplt_pd((b), (a)), (v)))
+#include "snip_kernel.h"
+#undef SNIP_NAME
+#undef SNIP_TARGET
+#undef SNIP_REAL
+#undef SNIP_VEC
+#undef SNIP_WIDTH
+#undef SNIP_LOAD
+#undef SNIP_STORE
+#undef SNIP_SET
+#undef SNIP_ADD
+#undef SNIP_SUB
+#undef SNIP_MUL
+#undef SNIP_DIV
+#undef SNIP_NEG
+#undef SNIP_MAX
+#undef SNIP_MIN
+#undef SNIP_SELECT
+
+/////////////////////////////////////////////////////////////////////////////
+//        AVX2 instance
+/////////////////////////////////////////////////////////////////////////////
+#define SNIP_NAME(f) f ## AVX2
+#define SNIP_TARGET __attribute__((target("avx2")))
+#define SNIP_REAL double
+#define SNIP_VEC __m256d
+#define SNIP_WIDTH 4
+#define SNIP_LOAD(p) _mm256_loadu_pd(p)
+#define SNIP_STORE(p, v) _mm256_storeu_pd((p), (v))
+#define SNIP_SET(x) _mm256_set1_pd(x)
+#define SNIP_ADD(x, y) _mm256_add_pd((x), (y))
+#define SNIP_SUB(x, y) _mm256_sub_pd((x), (y))
+#define SNIP_MUL(x, y) _mm256_mul_pd((x), (y))
+#define SNIP_DIV(x, y) _mm256_div_pd((x), (y))
+#define SNIP_NEG(x) _mm256_xor_pd((x), _mm256_set1_pd(-0.0))
+#define SNIP_MAX(b, e) _mm256_max_pd((e), (b))
+#define SNIP_MIN(b, a) _mm256_min_pd((b), (a))
+#define SNIP_SELECT(b, a, v) _mm256_blendv_pd((v), (b), _mm256_cmp_pd((b), (a), _CMP_LT_OQ))
+#include "snip_kernel.h"
+#undef SNIP_NAME
+#undef SNIP_TARGET
+#undef SNIP_REAL
+#undef SNIP_VEC
+#undef SNIP_WIDTH
+#undef SNIP_LOAD
+#undef SNIP_STORE
+#undef SNIP_SET
+#undef SNIP_ADD
+#undef SNIP_SUB
+#undef SNIP_MUL
+#undef SNIP_DIV
+#undef SNIP_NEG
+#undef SNIP_MAX
+#undef SNIP_MIN
+#undef SNIP_SELECT
+
+/////////////////////////////////////////////////////////////////////////////
+//        SSE2 instance, single precision
+/////////////////////////////////////////////////////////////////////////////
+#define SNIP_NAME(f) f ## SingleSSE2
+#define SNIP_TARGET __attribute__((target("sse2")))
+#define SNIP_REAL float
+#define SNIP_VEC __m128
+#define SNIP_WIDTH 4
+#define SNIP_LOAD(p) _mm_loadu_ps(p)
+#define SNIP_STORE(p, v) _mm_storeu_ps((p), (v))
+#define SNIP_SET(x) _mm_set1_ps(x)
+#define SNIP_ADD(x, y) _mm_add_ps((x), (y))
+#define SNIP_SUB(x, y) _mm_sub_ps((x), (y))
+#define SNIP_MUL(x, y) _mm_mul_ps((x), (y))
+#define SNIP_DIV(x, y) _mm_div_ps((x), (y))
+#define SNIP_NEG(x) _mm_xor_ps((x), _mm_set1_ps(-0.0f))
+#define SNIP_MAX(b, e) _mm_max_ps((e), (b))
+#define SNIP_MIN(b, a) _mm_min_ps((b), (a))
+#define SNIP_SELECT(b, a, v) _mm_or_ps(_mm_and_ps(_mm_cmplt_ps((b), (a)), (b)), \
+                                       _mm_andnot_ps(_mm_cmplt_ps((b), (a)), (v)))
+#include "snip_kernel.h"
+#undef SNIP_NAME
+#undef SNIP_TARGET
+#undef SNIP_REAL
+#undef SNIP_VEC
+#undef SNIP_WIDTH
+#undef SNIP_LOAD
+#undef SNIP_STORE
+#undef SNIP_SET
+#undef SNIP_ADD
+#undef SNIP_SUB
+#undef SNIP_MUL
+#undef SNIP_DIV
+#undef SNIP_NEG
+#undef SNIP_MAX
+#undef SNIP_MIN
+#undef SNIP_SELECT
+
+/////////////////////////////////////////////////////////////////////////////
+//        AVX2 instance, single precision
+/////////////////////////////////////////////////////////////////////////////
+#define SNIP_NAME(f) f ## SingleAVX2
+#define SNIP_TARGET __attribute__((target("avx2")))
+#define SNIP_REAL float
+#define SNIP_VEC __m256
+#define SNIP_WIDTH 8
+#define SNIP_LOAD(p) _mm256_loadu_ps(p)
+#define SNIP_STORE(p, v) _mm256_storeu_ps((p), (v))
+#define SNIP_SET(x) _mm256_set1_ps(x)
+#define SNIP_ADD(x, y) _mm256_add_ps((x), (y))
+#define SNIP_SUB(x, y) _mm256_sub_ps((x), (y))
+#define SNIP_MUL(x, y) _mm256_mul_ps((x), (y))
+#define SNIP_DIV(x, y) _mm256_div_ps((x), (y))
+#define SNIP_NEG(x) _mm256_xor_ps((x), _mm256_set1_ps(-0.0f))
+#define SNIP_MAX(b, e) _mm256_max_ps((e), (b))
+#define SNIP_MIN(b, a) _mm256_min_ps((b), (a))
+#define SNIP_SELECT(b, a, v) _mm256_blendv_ps((v), (b), _mm256_cmp_ps((b), (a), _CMP_LT_OQ))
+#include "snip_kernel.h"
+#undef SNIP_NAME
+#undef SNIP_TARGET
+#undef SNIP_REAL
+#undef SNIP_VEC
+#undef SNIP_WIDTH
+#undef SNIP_LOAD
+#undef SNIP_STORE
+#undef SNIP_SET
+#undef SNIP_ADD
+#undef SNIP_SUB
+#undef SNIP_MUL
+#undef SNIP_DIV
+#undef SNIP_NEG
+#undef SNIP_MAX
+#undef SNIP_MIN
+#undef SNIP_SELECT
+#endif
+
+int SpectrumInstructionSet(void)
+{
+/////////////////////////////////////////////////////////////////////////////
+//        Widest vector instruction set of the processor the package is
+//        running on: kInstructionAVX2, kInstructionSSE2 or
+//        kInstructionScalar. Detected by the first call; it can be made
+//        from any thread, as the kernels are called in parallel regions.
+/////////////////////////////////////////////////////////////////////////////
+   static int set = -1;
+   int value;
+#ifdef _OPENMP
+#pragma omp atomic read
+#endif
+   value = set;
+   if (value >= 0)
+      return value;
+#ifdef _OPENMP
+#pragma omp critical(rPeaksInstructionSet)
+#endif
+   {
+#ifdef _OPENMP
+#pragma omp atomic read
+#endif
+      value = set;
+      if (value < 0) {
+#ifdef SNIP_X86
+         __builtin_cpu_init();
+         if (__builtin_cpu_supports("avx2"))
+            value = kInstructionAVX2;
+         else if (__builtin_cpu_supports("sse2"))
+            value = kInstructionSSE2;
+         else
+#endif
+            value = kInstructionScalar;
+#ifdef _OPENMP
+#pragma omp atomic write
+#endif
+         set = value;
+      }
+   }
+   return value;
+}
+
+void SpectrumSNIPClip(const double *source, const double *average,
+                      double *dest, int ssize, int i, int filterOrder)
+{
+/////////////////////////////////////////////////////////////////////////////
+//        ONE CLIPPING PASS OF THE SNIP ALGORITHM
+//
+//        Function parameters:
+//        source-spectrum of the previous pass
+//        average-box averages of source, NULL if the smoothing is not
+//                included in the estimation of background
+//        dest-result for the channels i <= j < ssize - i, the other
+//             channels are not touched
+//        ssize-length of the spectrum
+//        i-width of the clipping window
+//        filterOrder-kBackOrder2, kBackOrder4, kBackOrder6, kBackOrder8
+//
+/////////////////////////////////////////////////////////////////////////////
+   int j = i, to = ssize - i;
+   if (to <= j)
+      return;
+#ifdef SNIP_X86
+   switch (SpectrumInstructionSet()) {
+   case kInstructionAVX2:
+      if (average == NULL)
+         j = SNIPClipPlainAVX2(source, dest, j, to, i, filterOrder);
+      else
+         j = SNIPClipSmoothAVX2(source, average, dest, j, to, i, filterOrder);
+      break;
+   case kInstructionSSE2:
+      if (average == NULL)
+         j = SNIPClipPlainSSE2(source, dest, j, to, i, filterOrder);
+      else
+         j = SNIPClipSmoothSSE2(source, average, dest, j, to, i, filterOrder);
+      break;
+   }
+#endif
+   if (average == NULL)
+      SNIPClipPlainScalar(source, dest, j, to, i, filterOrder);
+   else
+      SNIPClipSmoothScalar(source, average, dest, j, to, i, filterOrder);
+}
+
+void SpectrumSNIPAverage(const double *source, double *average,
+                         double *prefix, int ssize, int bw,
+                         ptrdiff_t origin)
+{
+/////////////////////////////////////////////////////////////////////////////
+//        BOX AVERAGES FOR THE SMOOTHED CLIPPING FILTERS
+//
+//        average[j] is the mean of source[w] for j-bw <= w <= j+bw,
+//        0 <= w < ssize. The sums are differences of prefix sums which
+//        restart every SNIP_BLOCK channels of the absolute channel number
+//        origin+j, so a part of a spectrum starting at a multiple of
+//        SNIP_BLOCK gets exactly the averages of the whole spectrum.
+//
+//        Function parameters:
+//        source-spectrum of the previous pass
+//        average-resulting box averages (ssize elements)
+//        prefix-working vector of ssize elements
+//        ssize-length of the spectrum
+//        bw-half width of the smoothing window (< SNIP_BLOCK)
+//        origin-absolute channel number of source[0]
+//
+/////////////////////////////////////////////////////////////////////////////
+   SNIPAverageScalar(source, average, prefix, ssize, bw, origin);
+}
+
+void SpectrumSNIPClipSingle(const float *source, const float *average,
+                            float *dest, int ssize, int i, int filterOrder)
+{
+/////////////////////////////////////////////////////////////////////////////
+//        SpectrumSNIPClip in single precision, twice as many channels
+//        per vector
+/////////////////////////////////////////////////////////////////////////////
+   int j = i, to = ssize - i;
+   if (to <= j)
+      return;
+#ifdef SNIP_X86
+   switch (SpectrumInstructionSet()) {
+   case kInstructionAVX2:
+      if (average == NULL)
+         j = SNIPClipPlainSingleAVX2(source, dest, j, to, i, filterOrder);
+      else
+         j = SNIPClipSmoothSingleAVX2(source, average, dest, j, to, i, filterOrder);
+      break;
+   case kInstructionSSE2:
+      if (average == NULL)
+         j = SNIPClipPlainSingleSSE2(source, dest, j, to, i, filterOrder);
+      else
+         j = SNIPClipSmoothSingleSSE2(source, average, dest, j, to, i, filterOrder);
+      break;
+   }
+#endif
+   if (average == NULL)
+      SNIPClipPlainSingleScalar(source, dest, j, to, i, filterOrder);
+   else
+      SNIPClipSmoothSingleScalar(source, average, dest, j, to, i, filterOrder);
+}
+
+void SpectrumSNIPAverageSingle(const float *source, float *average,
+                               double *prefix, int ssize, int bw,
+                               ptrdiff_t origin)
+{
+/////////////////////////////////////////////////////////////////////////////
+//        SpectrumSNIPAverage of a single precision spectrum; the prefix
+//        sums and the averages are evaluated in double precision and
+//        only the averages are rounded to single precision
+/////////////////////////////////////////////////////////////////////////////
+   SNIPAverageSingleScalar(source, average, prefix, ssize, bw, origin);
+}
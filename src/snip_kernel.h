@@ -0,0 +1,167 @@
+//__________________________________________________________________________
+//   CLIPPING PASS OF THE SNIP BACKGROUND ALGORITHM                        //
+//                                                                         //
+//   This file is included by snip.c once for every instruction set. The  //
+//   includer defines the element type, the vector type and its width and  //
+//   the vector operations:                                                //
+//                                                                         //
+//      SNIP_NAME(f)          name of the instance of function f           //
+//      SNIP_TARGET           function attribute selecting the target      //
+//      SNIP_REAL, SNIP_VEC   element and vector type                      //
+//      SNIP_WIDTH            number of elements in a vector               //
+//      SNIP_LOAD, SNIP_STORE unaligned load and store                     //
+//      SNIP_SET(x)           all elements equal x                         //
+//      SNIP_ADD, SNIP_SUB, SNIP_MUL, SNIP_DIV, SNIP_NEG                   //
+//      SNIP_MAX(b, e)        b < e ? e : b                                //
+//      SNIP_MIN(b, a)        b < a ? b : a                                //
+//      SNIP_SELECT(b, a, v)  b < a ? b : v                                //
+//                                                                         //
+//   The filters are evaluated with exactly the operations (and their      //
+//   order) of the original scalar code, so all instances give the same   //
+//   result. The functions process whole vectors of the range [from, to)   //
+//   and return the index where they stopped. The box averages of the      //
+//   smoothed filters are scalar and only made by the scalar instances.    //
+//____________________________________________________________________________
+
+static SNIP_TARGET int SNIP_NAME(SNIPClipPlain)(const SNIP_REAL *s,
+                                                SNIP_REAL *dest,
+                                                int from, int to, int i,
+                                                int filterOrder)
+{
+//clipping window i, filter applied to the spectrum s itself
+   int j, a2 = i / 2, a3 = i / 3, a4 = i / 4;
+   SNIP_VEC a, b, c, d, e;
+   const SNIP_VEC two = SNIP_SET(2), four = SNIP_SET(4), six = SNIP_SET(6),
+      eight = SNIP_SET(8), fifteen = SNIP_SET(15), twenty = SNIP_SET(20),
+      twentyeight = SNIP_SET(28), fiftysix = SNIP_SET(56),
+      seventy = SNIP_SET(70), zero = SNIP_SET(0);
+   for (j = from; j + SNIP_WIDTH <= to; j += SNIP_WIDTH) {
+      a = SNIP_LOAD(s + j);
+      b = SNIP_DIV(SNIP_ADD(SNIP_LOAD(s + j - i), SNIP_LOAD(s + j + i)), two);
+      if (filterOrder >= kBackOrder4) {
+         c = zero;
+         c = SNIP_SUB(c, SNIP_DIV(SNIP_LOAD(s + j - 2 * a2), six));
+         c = SNIP_ADD(c, SNIP_DIV(SNIP_MUL(four, SNIP_LOAD(s + j - a2)), six));
+         c = SNIP_ADD(c, SNIP_DIV(SNIP_MUL(four, SNIP_LOAD(s + j + a2)), six));
+         c = SNIP_SUB(c, SNIP_DIV(SNIP_LOAD(s + j + 2 * a2), six));
+      }
+      if (filterOrder >= kBackOrder6) {
+         d = zero;
+         d = SNIP_ADD(d, SNIP_DIV(SNIP_LOAD(s + j - 3 * a3), twenty));
+         d = SNIP_SUB(d, SNIP_DIV(SNIP_MUL(six, SNIP_LOAD(s + j - 2 * a3)), twenty));
+         d = SNIP_ADD(d, SNIP_DIV(SNIP_MUL(fifteen, SNIP_LOAD(s + j - a3)), twenty));
+         d = SNIP_ADD(d, SNIP_DIV(SNIP_MUL(fifteen, SNIP_LOAD(s + j + a3)), twenty));
+         d = SNIP_SUB(d, SNIP_DIV(SNIP_MUL(six, SNIP_LOAD(s + j + 2 * a3)), twenty));
+         d = SNIP_ADD(d, SNIP_DIV(SNIP_LOAD(s + j + 3 * a3), twenty));
+      }
+      if (filterOrder >= kBackOrder8) {
+         e = zero;
+         e = SNIP_SUB(e, SNIP_DIV(SNIP_LOAD(s + j - 4 * a4), seventy));
+         e = SNIP_ADD(e, SNIP_DIV(SNIP_MUL(eight, SNIP_LOAD(s + j - 3 * a4)), seventy));
+         e = SNIP_SUB(e, SNIP_DIV(SNIP_MUL(twentyeight, SNIP_LOAD(s + j - 2 * a4)), seventy));
+         e = SNIP_ADD(e, SNIP_DIV(SNIP_MUL(fiftysix, SNIP_LOAD(s + j - a4)), seventy));
+         e = SNIP_ADD(e, SNIP_DIV(SNIP_MUL(fiftysix, SNIP_LOAD(s + j + a4)), seventy));
+         e = SNIP_SUB(e, SNIP_DIV(SNIP_MUL(twentyeight, SNIP_LOAD(s + j + 2 * a4)), seventy));
+         e = SNIP_ADD(e, SNIP_DIV(SNIP_MUL(eight, SNIP_LOAD(s + j + 3 * a4)), seventy));
+         e = SNIP_SUB(e, SNIP_DIV(SNIP_LOAD(s + j + 4 * a4), seventy));
+         b = SNIP_MAX(b, e);
+      }
+      if (filterOrder >= kBackOrder6)
+         b = SNIP_MAX(b, d);
+      if (filterOrder >= kBackOrder4)
+         b = SNIP_MAX(b, c);
+      SNIP_STORE(dest + j, SNIP_MIN(b, a));
+   }
+   return j;
+}
+
+static SNIP_TARGET int SNIP_NAME(SNIPClipSmooth)(const SNIP_REAL *s,
+                                                 const SNIP_REAL *av,
+                                                 SNIP_REAL *dest,
+                                                 int from, int to, int i,
+                                                 int filterOrder)
+{
+//clipping window i, filter applied to the box averages av of s
+   int j, a2 = i / 2, a3 = i / 3, a4 = i / 4;
+   SNIP_VEC a, b, b4, b6, b8;
+   const SNIP_VEC two = SNIP_SET(2), four = SNIP_SET(4), six = SNIP_SET(6),
+      eight = SNIP_SET(8), fifteen = SNIP_SET(15), twenty = SNIP_SET(20),
+      twentyeight = SNIP_SET(28), fiftysix = SNIP_SET(56),
+      seventy = SNIP_SET(70);
+   for (j = from; j + SNIP_WIDTH <= to; j += SNIP_WIDTH) {
+      a = SNIP_LOAD(s + j);
+      b = SNIP_DIV(SNIP_ADD(SNIP_LOAD(av + j - i), SNIP_LOAD(av + j + i)), two);
+      if (filterOrder >= kBackOrder4) {
+         b4 = SNIP_NEG(SNIP_LOAD(av + j - 2 * a2));
+         b4 = SNIP_ADD(b4, SNIP_MUL(four, SNIP_LOAD(av + j - a2)));
+         b4 = SNIP_ADD(b4, SNIP_MUL(four, SNIP_LOAD(av + j + a2)));
+         b4 = SNIP_SUB(b4, SNIP_LOAD(av + j + 2 * a2));
+         b4 = SNIP_DIV(b4, six);
+      }
+      if (filterOrder >= kBackOrder6) {
+         b6 = SNIP_LOAD(av + j - 3 * a3);
+         b6 = SNIP_SUB(b6, SNIP_MUL(six, SNIP_LOAD(av + j - 2 * a3)));
+         b6 = SNIP_ADD(b6, SNIP_MUL(fifteen, SNIP_LOAD(av + j - a3)));
+         b6 = SNIP_ADD(b6, SNIP_MUL(fifteen, SNIP_LOAD(av + j + a3)));
+         b6 = SNIP_SUB(b6, SNIP_MUL(six, SNIP_LOAD(av + j + 2 * a3)));
+         b6 = SNIP_ADD(b6, SNIP_LOAD(av + j + 3 * a3));
+         b6 = SNIP_DIV(b6, twenty);
+      }
+      if (filterOrder >= kBackOrder8) {
+//coefficients (and signs) as in the reference implementation
+         b8 = SNIP_NEG(SNIP_LOAD(av + j - 4 * a4));
+         b8 = SNIP_ADD(b8, SNIP_MUL(eight, SNIP_LOAD(av + j - 3 * a4)));
+         b8 = SNIP_SUB(b8, SNIP_MUL(twentyeight, SNIP_LOAD(av + j - 2 * a4)));
+         b8 = SNIP_ADD(b8, SNIP_MUL(fiftysix, SNIP_LOAD(av + j - a4)));
+         b8 = SNIP_SUB(b8, SNIP_MUL(fiftysix, SNIP_LOAD(av + j + a4)));
+         b8 = SNIP_SUB(b8, SNIP_MUL(twentyeight, SNIP_LOAD(av + j + 2 * a4)));
+         b8 = SNIP_ADD(b8, SNIP_MUL(eight, SNIP_LOAD(av + j + 3 * a4)));
+         b8 = SNIP_SUB(b8, SNIP_LOAD(av + j + 4 * a4));
+         b8 = SNIP_DIV(b8, seventy);
+         b = SNIP_MAX(b, b8);
+      }
+      if (filterOrder >= kBackOrder6)
+         b = SNIP_MAX(b, b6);
+      if (filterOrder >= kBackOrder4)
+         b = SNIP_MAX(b, b4);
+      SNIP_STORE(dest + j, SNIP_SELECT(b, a, SNIP_LOAD(av + j)));
+   }
+   return j;
+}
+
+#if SNIP_WIDTH == 1
+static void SNIP_NAME(SNIPAverage)(const SNIP_REAL *source,
+                                   SNIP_REAL *average, double *prefix,
+                                   int ssize, int bw, ptrdiff_t origin)
+{
+//box averages of SpectrumSNIPAverage; the prefix sums and the averages
+//are evaluated in double precision and only the averages are rounded to
+//SNIP_REAL
+   int j, lo, hi, end;
+   double sum, left;
+   for (j = 0, sum = 0; j < ssize; j++) {
+      if ((origin + j) % SNIP_BLOCK == 0)
+         sum = 0;
+      sum += source[j];
+      prefix[j] = sum;
+   }
+   for (j = 0; j < ssize; j++) {
+      lo = j - bw;
+      if (lo < 0)
+         lo = 0;
+      hi = j + bw;
+      if (hi > ssize - 1)
+         hi = ssize - 1;
+      left = 0;
+      if (lo > 0 && (origin + lo) % SNIP_BLOCK != 0)
+         left = prefix[lo - 1];
+      end = lo + (SNIP_BLOCK - 1 - (int) ((origin + lo) % SNIP_BLOCK));
+      if (hi <= end)
+         sum = prefix[hi] - left;
+
+      else
+         sum = (prefix[end] - left) + prefix[hi];
+      average[j] = (SNIP_REAL) (sum / (hi - lo + 1));
+   }
+}
+#endif
@@ -38,61 +38,179 @@
 //   These NIM papers are also available as doc or ps files from:          //
 //____________________________________________________________________________
 
+#include <stdlib.h>
+#include <string.h>
+
+#define USE_FC_LEN_T
 #include <R.h>
 #include <Rinternals.h>
 #include <Rdefines.h>
+#include <R_ext/BLAS.h>
+#ifndef FCONE
+#define FCONE
+#endif
+
+#include "spectrum.h"
 
 
 double       fResolution;     //resolution of the neighboring peaks
 int         fgAverageWindow; //Average window of searched peaks
 int         fgIterations;    //Maximum number of decon iterations (default=3)
 
-   enum {
-       kBackOrder2 =0,
-       kBackOrder4 =1,
-       kBackOrder6 =2,
-       kBackOrder8 =3,
-       kBackIncreasingWindow =0,
-       kBackDecreasingWindow =1,
-       kBackSmoothing3 =3,
-       kBackSmoothing5 =5,
-       kBackSmoothing7 =7,
-       kBackSmoothing9 =9,
-       kBackSmoothing11 =11,
-       kBackSmoothing13 =13,
-       kBackSmoothing15 =15
-   };
-
 int SpectrumfgIterations    = 3;
 int SpectrumfgAverageWindow = 3;
 
 #define PEAK_WINDOW 1024
 
+//channels of the blocks of the Markov smoothing processed in parallel
+#define MARKOV_BLOCK 16384
+
 
 /////////////////////NEW FUNCTIONS  JANUARY 2006
-SEXP R_SpectrumBackground(SEXP R_spectrum,
-                                          SEXP R_numberIterations,
-                                          SEXP R_direction, SEXP R_filterOrder,
-                                          SEXP R_smoothing,SEXP R_smoothWindow,
-                                          SEXP R_compton)
+static const char *BackgroundParameters(int numberIterations,
+                                        int filterOrder, int smoothing,
+                                        int smoothWindow)
+{
+//checks of the parameters common to the background functions
+   if (numberIterations < 1)
+      return "Width of Clipping Window Must Be Positive";
+   if (smoothing == TRUE && smoothWindow != kBackSmoothing3 && smoothWindow != kBackSmoothing5 && smoothWindow != kBackSmoothing7 && smoothWindow != kBackSmoothing9 && smoothWindow != kBackSmoothing11 && smoothWindow != kBackSmoothing13 && smoothWindow != kBackSmoothing15)
+      return "Incorrect width of smoothing window";
+   if (filterOrder < kBackOrder2 || filterOrder > kBackOrder8)
+      return "Incorrect order of clipping filter";
+   return 0;
+}
+
+static void BackgroundClipping(double *working_space, double *average,
+                               double *prefix, int ssize, ptrdiff_t origin,
+                               int numberIterations, int direction,
+                               int filterOrder, int bw)
+{
+//clipping passes of SpectrumBackground, working_space holds the spectrum
+//twice and the background is left in its second half; average and prefix
+//are NULL without smoothing, origin is the absolute channel number of the
+//first channel
+   int i = 1, j;
+   if (direction == kBackIncreasingWindow)
+      i = 1;
+   else if(direction == kBackDecreasingWindow)
+      i = numberIterations;
+   do{
+      if (average != NULL)
+         SpectrumSNIPAverage(working_space + ssize, average, prefix, ssize, bw, origin);
+      SpectrumSNIPClip(working_space + ssize, average, working_space, ssize, i, filterOrder);
+      for (j = i; j < ssize - i; j++)
+         working_space[ssize + j] = working_space[j];
+      if (direction == kBackIncreasingWindow)
+         i+=1;
+      else if(direction == kBackDecreasingWindow)
+         i-=1;
+   }while((direction == kBackIncreasingWindow && i <= numberIterations) || (direction == kBackDecreasingWindow && i >= 1));
+}
+
+static void BackgroundClippingSingle(float *working_space, float *average,
+                                     double *prefix, int ssize,
+                                     int numberIterations, int direction,
+                                     int filterOrder, int bw)
+{
+//BackgroundClipping in single precision
+   int i = 1, j;
+   if (direction == kBackIncreasingWindow)
+      i = 1;
+   else if(direction == kBackDecreasingWindow)
+      i = numberIterations;
+   do{
+      if (average != NULL)
+         SpectrumSNIPAverageSingle(working_space + ssize, average, prefix, ssize, bw, 0);
+      SpectrumSNIPClipSingle(working_space + ssize, average, working_space, ssize, i, filterOrder);
+      for (j = i; j < ssize - i; j++)
+         working_space[ssize + j] = working_space[j];
+      if (direction == kBackIncreasingWindow)
+         i+=1;
+      else if(direction == kBackDecreasingWindow)
+         i-=1;
+   }while((direction == kBackIncreasingWindow && i <= numberIterations) || (direction == kBackDecreasingWindow && i >= 1));
+}
+
+static void BackgroundCompton(const double *spectrum, double *working_space,
+                              int ssize)
+{
+//estimation of the Compton edges of SpectrumBackground, working_space
+//holds the background twice and its second half is updated
+   int i, j, b1, b2, priz;
+   double a, b, c, d, yb1, yb2;
+   for (i = 0, b2 = 0; i < ssize; i++){
+      b1 = b2;
+      a = working_space[i], b = spectrum[i];
+      j = i;
+      if (fabs(a - b) >= 1) {
+         b1 = i - 1;
+         if (b1 < 0)
+            b1 = 0;
+         yb1 = working_space[b1];
+         for (b2 = b1 + 1, c = 0, priz = 0; priz == 0 && b2 < ssize; b2++){
+            a = working_space[b2], b = spectrum[b2];
+            c = c + b - yb1;
+            if (fabs(a - b) < 1) {
+               priz = 1;
+               yb2 = b;
+            }
+         }
+         if (b2 == ssize)
+            b2 -= 1;
+         yb2 = working_space[b2];
+         if (yb1 <= yb2){
+            for (j = b1, c = 0; j <= b2; j++){
+               b = spectrum[j];
+               c = c + b - yb1;
+            }
+            if (c > 1){
+               c = (yb2 - yb1) / c;
+               for (j = b1, d = 0; j <= b2 && j < ssize; j++){
+                  b = spectrum[j];
+                  d = d + b - yb1;
+                  a = c * d + yb1;
+                  working_space[ssize + j] = a;
+               }
+            }
+         }
+
+         else{
+            for (j = b2, c = 0; j >= b1; j--){
+               b = spectrum[j];
+               c = c + b - yb2;
+            }
+            if (c > 1){
+               c = (yb1 - yb2) / c;
+               for (j = b2, d = 0;j >= b1 && j >= 0; j--){
+                  b = spectrum[j];
+                  d = d + b - yb2;
+                  a = c * d + yb2;
+                  working_space[ssize + j] = a;
+               }
+            }
+         }
+         i=b2;
+      }
+   }
+}
+
+const char *SpectrumBackground(const double *spectrum, double *background,
+                               int ssize, int numberIterations,
+                               int direction, int filterOrder,
+                               int smoothing, int smoothWindow, int compton)
 {
-  double * spectrum=REAL(R_spectrum);
-  int numberIterations=INTEGER(R_numberIterations)[0];
-  int ssize=LENGTH(R_spectrum);
-  int direction=INTEGER(R_direction)[0];
-  int filterOrder=INTEGER(R_filterOrder)[0];
-  int smoothing=INTEGER(R_smoothing)[0];
-  int smoothWindow=INTEGER(R_smoothWindow)[0];
-  int compton=INTEGER(R_compton)[0];
-  SEXP f;
 /////////////////////////////////////////////////////////////////////////////
 //        ONE-DIMENSIONAL BACKGROUND ESTIMATION FUNCTION - GENERAL FUNCTION
 //
 //        This function calculates background spectrum from source spectrum.
-//        The result is placed in the vector pointed by spe1945ctrum pointer.
+//        The result is placed in the vector pointed by background pointer.
+//        The function does not call R, so it can run in any thread; it
+//        returns 0 or an error message.
 //
 //        Function parameters:
 //        spectrum-pointer to the vector of source spectrum
+//        background-pointer to the resulting vector of ssize elements
 //        ssize-length of the spectrum vector
 //        numberIterations-maximal width of clipping window,
 //        direction- direction of change of clipping window
@@ -123,759 +241,701 @@ SEXP R_SpectrumBackground(SEXP R_spectrum,
 ///////////////////////////////////////////////////////////////////////////////
 //
 
-   int i, j, w, bw, b1, b2, priz;
-   double a, b, c, d, e, yb1, yb2, ai, av, men, b4, c4, d4, e4, b6, c6, d6, e6, f6, g6, b8, c8, d8, e8, f8, g8, h8, i8;
+   int i, j;
+   double *average = NULL, *prefix = NULL;
+   const char *message;
    if (ssize <= 0)
-      Rf_error ("Wrong Parameters");
-   if (numberIterations < 1)
-      Rf_error( "Width of Clipping Window Must Be Positive");
+      return "Wrong Parameters";
+   message = BackgroundParameters(numberIterations, filterOrder, smoothing,
+                                  smoothWindow);
+   if (message != 0)
+      return message;
    if (ssize < 2 * numberIterations + 1)
-      Rf_error( "Too Large Clipping Window");
-   if (smoothing == TRUE && smoothWindow != kBackSmoothing3 && smoothWindow != kBackSmoothing5 && smoothWindow != kBackSmoothing7 && smoothWindow != kBackSmoothing9 && smoothWindow != kBackSmoothing11 && smoothWindow != kBackSmoothing13 && smoothWindow != kBackSmoothing15)
-      Rf_error( "Incorrect width of smoothing window");
-   double working_space[2 * ssize];
+      return "Too Large Clipping Window";
+   size_t mark = SpectrumWorkspaceMark();
+   double *working_space = SpectrumWorkspaceAlloc(2 * (size_t) ssize);
+   if (smoothing == TRUE) {
+      average = SpectrumWorkspaceAlloc(ssize);
+      prefix = SpectrumWorkspaceAlloc(ssize);
+   }
+   if (working_space == NULL || (smoothing == TRUE && (average == NULL || prefix == NULL))) {
+      SpectrumWorkspaceRelease(mark);
+      return "Not enough memory for working space";
+   }
    for (i = 0; i < ssize; i++){
       working_space[i] = spectrum[i];
       working_space[i + ssize] = spectrum[i];
    }
-   bw=(smoothWindow-1)/2;
-   if (direction == kBackIncreasingWindow)
-      i = 1;
-   else if(direction == kBackDecreasingWindow)
-      i = numberIterations;
-   if (filterOrder == kBackOrder2) {
-      do{
-         for (j = i; j < ssize - i; j++) {
-            if (smoothing == FALSE){
-               a = working_space[ssize + j];
-               b = (working_space[ssize + j - i] + working_space[ssize + j + i]) / 2.0;
-               if (b < a)
-                  a = b;
-               working_space[j] = a;
-            }
-
-            else if (smoothing == TRUE){
-               a = working_space[ssize + j];
-               av = 0;
-               men = 0;
-               for (w = j - bw; w <= j + bw; w++){
-                  if ( w >= 0 && w < ssize){
-                     av += working_space[ssize + w];
-                     men +=1;
-                  }
-               }
-               av = av / men;
-               b = 0;
-               men = 0;
-               for (w = j - i - bw; w <= j - i + bw; w++){
-                  if ( w >= 0 && w < ssize){
-                     b += working_space[ssize + w];
-                     men +=1;
-                  }
-               }
-               b = b / men;
-               c = 0;
-               men = 0;
-               for (w = j + i - bw; w <= j + i + bw; w++){
-                  if ( w >= 0 && w < ssize){
-                     c += working_space[ssize + w];
-                     men +=1;
-                  }
-               }
-               c = c / men;
-               b = (b + c) / 2;
-               if (b < a)
-                  av = b;
-               working_space[j]=av;
-            }
-         }
-         for (j = i; j < ssize - i; j++)
-            working_space[ssize + j] = working_space[j];
-         if (direction == kBackIncreasingWindow)
-            i+=1;
-         else if(direction == kBackDecreasingWindow)
-            i-=1;
-      } while ((direction == kBackIncreasingWindow && i <= numberIterations || direction == kBackDecreasingWindow && i >= 1));
-   }
-
-   else if (filterOrder == kBackOrder4) {
-      do{
-         for (j = i; j < ssize - i; j++) {
-            if (smoothing == FALSE){
-               a = working_space[ssize + j];
-               b = (working_space[ssize + j - i] + working_space[ssize + j + i]) / 2.0;
-               c = 0;
-               ai = i / 2;
-               c -= working_space[ssize + j - (int) (2 * ai)] / 6;
-               c += 4 * working_space[ssize + j - (int) ai] / 6;
-               c += 4 * working_space[ssize + j + (int) ai] / 6;
-               c -= working_space[ssize + j + (int) (2 * ai)] / 6;
-               if (b < c)
-                  b = c;
-               if (b < a)
-                  a = b;
-               working_space[j] = a;
-            }
+   BackgroundClipping(working_space, average, prefix, ssize, 0,
+                      numberIterations, direction, filterOrder,
+                      (smoothWindow - 1) / 2);
 
-            else if (smoothing == TRUE){
-               a = working_space[ssize + j];
-               av = 0;
-               men = 0;
-               for (w = j - bw; w <= j + bw; w++){
-                  if ( w >= 0 && w < ssize){
-                     av += working_space[ssize + w];
-                     men +=1;
-                  }
-               }
-               av = av / men;
-               b = 0;
-               men = 0;
-               for (w = j - i - bw; w <= j - i + bw; w++){
-                  if ( w >= 0 && w < ssize){
-                     b += working_space[ssize + w];
-                     men +=1;
-                  }
-               }
-               b = b / men;
-               c = 0;
-               men = 0;
-               for (w = j + i - bw; w <= j + i + bw; w++){
-                  if ( w >= 0 && w < ssize){
-                     c += working_space[ssize + w];
-                     men +=1;
-                  }
-               }
-               c = c / men;
-               b = (b + c) / 2;
-               ai = i / 2;
-               b4 = 0, men = 0;
-               for (w = j - (int)(2 * ai) - bw; w <= j - (int)(2 * ai) + bw; w++){
-                  if (w >= 0 && w < ssize){
-                     b4 += working_space[ssize + w];
-                     men +=1;
-                  }
-               }
-               b4 = b4 / men;
-               c4 = 0, men = 0;
-               for (w = j - (int)ai - bw; w <= j - (int)ai + bw; w++){
-                  if (w >= 0 && w < ssize){
-                     c4 += working_space[ssize + w];
-                     men +=1;
-                  }
-               }
-               c4 = c4 / men;
-               d4 = 0, men = 0;
-               for (w = j + (int)ai - bw; w <= j + (int)ai + bw; w++){
-                  if (w >= 0 && w < ssize){
-                     d4 += working_space[ssize + w];
-                     men +=1;
-                  }
-               }
-               d4 = d4 / men;
-               e4 = 0, men = 0;
-               for (w = j + (int)(2 * ai) - bw; w <= j + (int)(2 * ai) + bw; w++){
-                  if (w >= 0 && w < ssize){
-                     e4 += working_space[ssize + w];
-                     men +=1;
-                  }
-               }
-               e4 = e4 / men;
-               b4 = (-b4 + 4 * c4 + 4 * d4 - e4) / 6;
-               if (b < b4)
-                  b = b4;
-               if (b < a)
-                  av = b;
-               working_space[j]=av;
-            }
-         }
-         for (j = i; j < ssize - i; j++)
-            working_space[ssize + j] = working_space[j];
-         if (direction == kBackIncreasingWindow)
-            i+=1;
-         else if(direction == kBackDecreasingWindow)
-            i-=1;
-      }while(direction == kBackIncreasingWindow && i <= numberIterations || direction == kBackDecreasingWindow && i >= 1);
-   }
-
-   else if (filterOrder == kBackOrder6) {
-      do{
-         for (j = i; j < ssize - i; j++) {
-            if (smoothing == FALSE){
-               a = working_space[ssize + j];
-               b = (working_space[ssize + j - i] + working_space[ssize + j + i]) / 2.0;
-               c = 0;
-               ai = i / 2;
-               c -= working_space[ssize + j - (int) (2 * ai)] / 6;
-               c += 4 * working_space[ssize + j - (int) ai] / 6;
-               c += 4 * working_space[ssize + j + (int) ai] / 6;
-               c -= working_space[ssize + j + (int) (2 * ai)] / 6;
-               d = 0;
-               ai = i / 3;
-               d += working_space[ssize + j - (int) (3 * ai)] / 20;
-               d -= 6 * working_space[ssize + j - (int) (2 * ai)] / 20;
-               d += 15 * working_space[ssize + j - (int) ai] / 20;
-               d += 15 * working_space[ssize + j + (int) ai] / 20;
-               d -= 6 * working_space[ssize + j + (int) (2 * ai)] / 20;
-               d += working_space[ssize + j + (int) (3 * ai)] / 20;
-               if (b < d)
-                  b = d;
-               if (b < c)
-                  b = c;
-               if (b < a)
-                  a = b;
-               working_space[j] = a;
-            }
+   if (compton == TRUE)
+      BackgroundCompton(spectrum, working_space, ssize);
+   for (j = 0; j < ssize; j++){
+      background[j] = working_space[ssize + j];
+   }
+   SpectrumWorkspaceRelease(mark);
+   return 0;
+}
 
-            else if (smoothing == TRUE){
-               a = working_space[ssize + j];
-               av = 0;
-               men = 0;
-               for (w = j - bw; w <= j + bw; w++){
-                  if ( w >= 0 && w < ssize){
-                     av += working_space[ssize + w];
-                     men +=1;
-                  }
-               }
-               av = av / men;
-               b = 0;
-               men = 0;
-               for (w = j - i - bw; w <= j - i + bw; w++){
-                  if ( w >= 0 && w < ssize){
-                     b += working_space[ssize + w];
-                     men +=1;
-                  }
-               }
-               b = b / men;
-               c = 0;
-               men = 0;
-               for (w = j + i - bw; w <= j + i + bw; w++){
-                  if ( w >= 0 && w < ssize){
-                     c += working_space[ssize + w];
-                     men +=1;
-                  }
-               }
-               c = c / men;
-               b = (b + c) / 2;
-               ai = i / 2;
-               b4 = 0, men = 0;
-               for (w = j - (int)(2 * ai) - bw; w <= j - (int)(2 * ai) + bw; w++){
-                  if (w >= 0 && w < ssize){
-                     b4 += working_space[ssize + w];
-                     men +=1;
-                  }
-               }
-               b4 = b4 / men;
-               c4 = 0, men = 0;
-               for (w = j - (int)ai - bw; w <= j - (int)ai + bw; w++){
-                  if (w >= 0 && w < ssize){
-                     c4 += working_space[ssize + w];
-                     men +=1;
-                  }
-               }
-               c4 = c4 / men;
-               d4 = 0, men = 0;
-               for (w = j + (int)ai - bw; w <= j + (int)ai + bw; w++){
-                  if (w >= 0 && w < ssize){
-                     d4 += working_space[ssize + w];
-                     men +=1;
-                  }
-               }
-               d4 = d4 / men;
-               e4 = 0, men = 0;
-               for (w = j + (int)(2 * ai) - bw; w <= j + (int)(2 * ai) + bw; w++){
-                  if (w >= 0 && w < ssize){
-                     e4 += working_space[ssize + w];
-                     men +=1;
-                  }
-               }
-               e4 = e4 / men;
-               b4 = (-b4 + 4 * c4 + 4 * d4 - e4) / 6;
-               ai = i / 3;
-               b6 = 0, men = 0;
-               for (w = j - (int)(3 * ai) - bw; w <= j - (int)(3 * ai) + bw; w++){
-                  if (w >= 0 && w < ssize){
-                     b6 += working_space[ssize + w];
-                     men +=1;
-                  }
-               }
-               b6 = b6 / men;
-               c6 = 0, men = 0;
-               for (w = j - (int)(2 * ai) - bw; w <= j - (int)(2 * ai) + bw; w++){
-                  if (w >= 0 && w < ssize){
-                     c6 += working_space[ssize + w];
-                     men +=1;
-                  }
-               }
-               c6 = c6 / men;
-               d6 = 0, men = 0;
-               for (w = j - (int)ai - bw; w <= j - (int)ai + bw; w++){
-                  if (w >= 0 && w < ssize){
-                     d6 += working_space[ssize + w];
-                     men +=1;
-                  }
-               }
-               d6 = d6 / men;
-               e6 = 0, men = 0;
-               for (w = j + (int)ai - bw; w <= j + (int)ai + bw; w++){
-                  if (w >= 0 && w < ssize){
-                     e6 += working_space[ssize + w];
-                     men +=1;
-                  }
-               }
-               e6 = e6 / men;
-               f6 = 0, men = 0;
-               for (w = j + (int)(2 * ai) - bw; w <= j + (int)(2 * ai) + bw; w++){
-                  if (w >= 0 && w < ssize){
-                     f6 += working_space[ssize + w];
-                     men +=1;
-                  }
-               }
-               f6 = f6 / men;
-               g6 = 0, men = 0;
-               for (w = j + (int)(3 * ai) - bw; w <= j + (int)(3 * ai) + bw; w++){
-                  if (w >= 0 && w < ssize){
-                     g6 += working_space[ssize + w];
-                     men +=1;
-                  }
-               }
-               g6 = g6 / men;
-               b6 = (b6 - 6 * c6 + 15 * d6 + 15 * e6 - 6 * f6 + g6) / 20;
-               if (b < b6)
-                  b = b6;
-               if (b < b4)
-                  b = b4;
-               if (b < a)
-                  av = b;
-               working_space[j]=av;
-            }
-         }
-         for (j = i; j < ssize - i; j++)
-            working_space[ssize + j] = working_space[j];
-         if (direction == kBackIncreasingWindow)
-            i+=1;
-         else if(direction == kBackDecreasingWindow)
-            i-=1;
-      }while(direction == kBackIncreasingWindow && i <= numberIterations || direction == kBackDecreasingWindow && i >= 1);
-   }
-
-   else if (filterOrder == kBackOrder8) {
-      do{
-         for (j = i; j < ssize - i; j++) {
-            if (smoothing == FALSE){
-               a = working_space[ssize + j];
-               b = (working_space[ssize + j - i] + working_space[ssize + j + i]) / 2.0;
-               c = 0;
-               ai = i / 2;
-               c -= working_space[ssize + j - (int) (2 * ai)] / 6;
-               c += 4 * working_space[ssize + j - (int) ai] / 6;
-               c += 4 * working_space[ssize + j + (int) ai] / 6;
-               c -= working_space[ssize + j + (int) (2 * ai)] / 6;
-               d = 0;
-               ai = i / 3;
-               d += working_space[ssize + j - (int) (3 * ai)] / 20;
-               d -= 6 * working_space[ssize + j - (int) (2 * ai)] / 20;
-               d += 15 * working_space[ssize + j - (int) ai] / 20;
-               d += 15 * working_space[ssize + j + (int) ai] / 20;
-               d -= 6 * working_space[ssize + j + (int) (2 * ai)] / 20;
-               d += working_space[ssize + j + (int) (3 * ai)] / 20;
-               e = 0;
-               ai = i / 4;
-               e -= working_space[ssize + j - (int) (4 * ai)] / 70;
-               e += 8 * working_space[ssize + j - (int) (3 * ai)] / 70;
-               e -= 28 * working_space[ssize + j - (int) (2 * ai)] / 70;
-               e += 56 * working_space[ssize + j - (int) ai] / 70;
-               e += 56 * working_space[ssize + j + (int) ai] / 70;
-               e -= 28 * working_space[ssize + j + (int) (2 * ai)] / 70;
-               e += 8 * working_space[ssize + j + (int) (3 * ai)] / 70;
-               e -= working_space[ssize + j + (int) (4 * ai)] / 70;
-               if (b < e)
-                  b = e;
-               if (b < d)
-                  b = d;
-               if (b < c)
-                  b = c;
-               if (b < a)
-                  a = b;
-               working_space[j] = a;
-            }
+void SpectrumBackgroundReach(int numberIterations, int smoothing,
+                             int smoothWindow, ptrdiff_t *left,
+                             ptrdiff_t *right)
+{
+//channels to the left and to the right of a channel its background
+//depends on, see SpectrumBackgroundPart
+   ptrdiff_t n = numberIterations;
+   *right = n * (n + 1) / 2;
+   *left = *right;
+   if (smoothing == TRUE) {
+      *right += n * ((smoothWindow - 1) / 2);
+      *left = *right + n * (SNIP_BLOCK - 1);
+   }
+}
 
-            else if (smoothing == TRUE){
-               a = working_space[ssize + j];
-               av = 0;
-               men = 0;
-               for (w = j - bw; w <= j + bw; w++){
-                  if ( w >= 0 && w < ssize){
-                     av += working_space[ssize + w];
-                     men +=1;
-                  }
-               }
-               av = av / men;
-               b = 0;
-               men = 0;
-               for (w = j - i - bw; w <= j - i + bw; w++){
-                  if ( w >= 0 && w < ssize){
-                     b += working_space[ssize + w];
-                     men +=1;
-                  }
-               }
-               b = b / men;
-               c = 0;
-               men = 0;
-               for (w = j + i - bw; w <= j + i + bw; w++){
-                  if ( w >= 0 && w < ssize){
-                     c += working_space[ssize + w];
-                     men +=1;
-                  }
-               }
-               c = c / men;
-               b = (b + c) / 2;
-               ai = i / 2;
-               b4 = 0, men = 0;
-               for (w = j - (int)(2 * ai) - bw; w <= j - (int)(2 * ai) + bw; w++){
-                  if (w >= 0 && w < ssize){
-                     b4 += working_space[ssize + w];
-                     men +=1;
-                  }
-               }
-               b4 = b4 / men;
-               c4 = 0, men = 0;
-               for (w = j - (int)ai - bw; w <= j - (int)ai + bw; w++){
-                  if (w >= 0 && w < ssize){
-                     c4 += working_space[ssize + w];
-                     men +=1;
-                  }
-               }
-               c4 = c4 / men;
-               d4 = 0, men = 0;
-               for (w = j + (int)ai - bw; w <= j + (int)ai + bw; w++){
-                  if (w >= 0 && w < ssize){
-                     d4 += working_space[ssize + w];
-                     men +=1;
-                  }
-               }
-               d4 = d4 / men;
-               e4 = 0, men = 0;
-               for (w = j + (int)(2 * ai) - bw; w <= j + (int)(2 * ai) + bw; w++){
-                  if (w >= 0 && w < ssize){
-                     e4 += working_space[ssize + w];
-                     men +=1;
-                  }
-               }
-               e4 = e4 / men;
-               b4 = (-b4 + 4 * c4 + 4 * d4 - e4) / 6;
-               ai = i / 3;
-               b6 = 0, men = 0;
-               for (w = j - (int)(3 * ai) - bw; w <= j - (int)(3 * ai) + bw; w++){
-                  if (w >= 0 && w < ssize){
-                     b6 += working_space[ssize + w];
-                     men +=1;
-                  }
-               }
-               b6 = b6 / men;
-               c6 = 0, men = 0;
-               for (w = j - (int)(2 * ai) - bw; w <= j - (int)(2 * ai) + bw; w++){
-                  if (w >= 0 && w < ssize){
-                     c6 += working_space[ssize + w];
-                     men +=1;
-                  }
-               }
-               c6 = c6 / men;
-               d6 = 0, men = 0;
-               for (w = j - (int)ai - bw; w <= j - (int)ai + bw; w++){
-                  if (w >= 0 && w < ssize){
-                     d6 += working_space[ssize + w];
-                     men +=1;
-                  }
-               }
-               d6 = d6 / men;
-               e6 = 0, men = 0;
-               for (w = j + (int)ai - bw; w <= j + (int)ai + bw; w++){
-                  if (w >= 0 && w < ssize){
-                     e6 += working_space[ssize + w];
-                     men +=1;
-                  }
-               }
-               e6 = e6 / men;
-               f6 = 0, men = 0;
-               for (w = j + (int)(2 * ai) - bw; w <= j + (int)(2 * ai) + bw; w++){
-                  if (w >= 0 && w < ssize){
-                     f6 += working_space[ssize + w];
-                     men +=1;
-                  }
-               }
-               f6 = f6 / men;
-               g6 = 0, men = 0;
-               for (w = j + (int)(3 * ai) - bw; w <= j + (int)(3 * ai) + bw; w++){
-                  if (w >= 0 && w < ssize){
-                     g6 += working_space[ssize + w];
-                     men +=1;
-                  }
-               }
-               g6 = g6 / men;
-               b6 = (b6 - 6 * c6 + 15 * d6 + 15 * e6 - 6 * f6 + g6) / 20;
-               ai = i / 4;
-               b8 = 0, men = 0;
-               for (w = j - (int)(4 * ai) - bw; w <= j - (int)(4 * ai) + bw; w++){
-                  if (w >= 0 && w < ssize){
-                     b8 += working_space[ssize + w];
-                     men +=1;
-                  }
-               }
-               b8 = b8 / men;
-               c8 = 0, men = 0;
-               for (w = j - (int)(3 * ai) - bw; w <= j - (int)(3 * ai) + bw; w++){
-                  if (w >= 0 && w < ssize){
-                     c8 += working_space[ssize + w];
-                     men +=1;
-                  }
-               }
-               c8 = c8 / men;
-               d8 = 0, men = 0;
-               for (w = j - (int)(2 * ai) - bw; w <= j - (int)(2 * ai) + bw; w++){
-                  if (w >= 0 && w < ssize){
-                     d8 += working_space[ssize + w];
-                     men +=1;
-                  }
-               }
-               d8 = d8 / men;
-               e8 = 0, men = 0;
-               for (w = j - (int)ai - bw; w <= j - (int)ai + bw; w++){
-                  if (w >= 0 && w < ssize){
-                     e8 += working_space[ssize + w];
-                     men +=1;
-                  }
-               }
-               e8 = e8 / men;
-               f8 = 0, men = 0;
-               for (w = j + (int)ai - bw; w <= j + (int)ai + bw; w++){
-                  if (w >= 0 && w < ssize){
-                     f8 += working_space[ssize + w];
-                     men +=1;
-                  }
-               }
-               f8 = f8 / men;
-               g8 = 0, men = 0;
-               for (w = j + (int)(2 * ai) - bw; w <= j + (int)(2 * ai) + bw; w++){
-                  if (w >= 0 && w < ssize){
-                     g8 += working_space[ssize + w];
-                     men +=1;
-                  }
-               }
-               g8 = g8 / men;
-               h8 = 0, men = 0;
-               for (w = j + (int)(3 * ai) - bw; w <= j + (int)(3 * ai) + bw; w++){
-                  if (w >= 0 && w < ssize){
-                     h8 += working_space[ssize + w];
-                     men +=1;
-                  }
-               }
-               h8 = h8 / men;
-               i8 = 0, men = 0;
-               for (w = j + (int)(4 * ai) - bw; w <= j + (int)(4 * ai) + bw; w++){
-                  if (w >= 0 && w < ssize){
-                     i8 += working_space[ssize + w];
-                     men +=1;
-                  }
-               }
-               i8 = i8 / men;
-               b8 = ( -b8 + 8 * c8 - 28 * d8 + 56 * e8 - 56 * f8 - 28 * g8 + 8 * h8 - i8)/70;
-               if (b < b8)
-                  b = b8;
-               if (b < b6)
-                  b = b6;
-               if (b < b4)
-                  b = b4;
-               if (b < a)
-                  av = b;
-               working_space[j]=av;
-            }
-         }
-         for (j = i; j < ssize - i; j++)
-            working_space[ssize + j] = working_space[j];
-         if (direction == kBackIncreasingWindow)
-            i += 1;
-         else if(direction == kBackDecreasingWindow)
-            i -= 1;
-      }while(direction == kBackIncreasingWindow && i <= numberIterations || direction == kBackDecreasingWindow && i >= 1);
+const char *SpectrumBackgroundPart(const double *spectrum, double *background,
+                                   int ssize, ptrdiff_t origin,
+                                   int numberIterations, int direction,
+                                   int filterOrder, int smoothing,
+                                   int smoothWindow)
+{
+/////////////////////////////////////////////////////////////////////////////
+//        BACKGROUND OF A PART OF A SPECTRUM
+//
+//        Clipping of SpectrumBackground (without the Compton edge) applied
+//        to the channels origin..origin+ssize-1 of a longer spectrum.
+//        The pass of clipping window i looks i channels (plus the half
+//        width bw of the smoothing window) to both sides of the result of
+//        the previous pass, so the background of a channel depends on the
+//        channels up to
+//                  numberIterations*(numberIterations+1)/2
+//                  + numberIterations*bw
+//        to its right. With smoothing, the box averages are differences
+//        of prefix sums running from the start of a block of SNIP_BLOCK
+//        (512) channels, so every pass may look up to 511 channels farther
+//        to the left, adding numberIterations*511 to the reach on that
+//        side. The background of a channel whose reach lies inside the part
+//        (or extends beyond it only past an end of the whole spectrum) is
+//        identical to the background of the whole spectrum, provided
+//        origin is a multiple of SNIP_BLOCK when smoothing is included. The parts may
+//        be shorter than the clipping window; the length of the whole
+//        spectrum is checked by the caller.
+//
+//        Function parameters:
+//        spectrum-pointer to the part of the source spectrum
+//        background-pointer to the resulting vector of ssize elements
+//        ssize-length of the part
+//        origin-absolute channel number of spectrum[0]
+//        the other parameters are those of SpectrumBackground
+//
+/////////////////////////////////////////////////////////////////////////////
+   int j;
+   double *working_space, *average = NULL, *prefix = NULL;
+   const char *message;
+   if (ssize <= 0 || origin < 0)
+      return "Wrong Parameters";
+   message = BackgroundParameters(numberIterations, filterOrder, smoothing,
+                                  smoothWindow);
+   if (message != 0)
+      return message;
+   size_t mark = SpectrumWorkspaceMark();
+   working_space = SpectrumWorkspaceAlloc(2 * (size_t) ssize);
+   if (smoothing == TRUE) {
+      average = SpectrumWorkspaceAlloc(ssize);
+      prefix = SpectrumWorkspaceAlloc(ssize);
+   }
+   if (working_space == NULL || (smoothing == TRUE && (average == NULL || prefix == NULL))) {
+      SpectrumWorkspaceRelease(mark);
+      return "Not enough memory for working space";
    }
+   for (j = 0; j < ssize; j++){
+      working_space[j] = spectrum[j];
+      working_space[j + ssize] = spectrum[j];
+   }
+   BackgroundClipping(working_space, average, prefix, ssize, origin,
+                      numberIterations, direction, filterOrder,
+                      (smoothWindow - 1) / 2);
+   for (j = 0; j < ssize; j++)
+      background[j] = working_space[ssize + j];
+   SpectrumWorkspaceRelease(mark);
+   return 0;
+}
 
+const char *SpectrumBackgroundSingle(const float *spectrum,
+                                     double *background, int ssize,
+                                     int numberIterations, int direction,
+                                     int filterOrder, int smoothing,
+                                     int smoothWindow, int compton)
+{
+/////////////////////////////////////////////////////////////////////////////
+//        SpectrumBackground of a single precision spectrum with the
+//        clipping passes in single precision, which halves the memory
+//        traffic of the passes. The result is rounded like the spectrum
+//        (relative error about 1e-7). The Compton edges are estimated in
+//        double precision from the clipped background.
+//
+//        Function parameters:
+//        spectrum-pointer to the vector of source spectrum
+//        the other parameters are those of SpectrumBackground
+//
+/////////////////////////////////////////////////////////////////////////////
+   int j;
+   float *working_space, *average = NULL;
+   double *prefix = NULL, *source, *clipped;
+   const char *message;
+   if (ssize <= 0)
+      return "Wrong Parameters";
+   message = BackgroundParameters(numberIterations, filterOrder, smoothing,
+                                  smoothWindow);
+   if (message != 0)
+      return message;
+   if (ssize < 2 * numberIterations + 1)
+      return "Too Large Clipping Window";
+   size_t mark = SpectrumWorkspaceMark();
+//the arena hands out doubles, two floats each
+   working_space = (float *) SpectrumWorkspaceAlloc(ssize);
+   if (smoothing == TRUE) {
+      average = (float *) SpectrumWorkspaceAlloc(((size_t) ssize + 1) / 2);
+      prefix = SpectrumWorkspaceAlloc(ssize);
+   }
+   if (working_space == NULL || (smoothing == TRUE && (average == NULL || prefix == NULL))) {
+      SpectrumWorkspaceRelease(mark);
+      return "Not enough memory for working space";
+   }
+   for (j = 0; j < ssize; j++){
+      working_space[j] = spectrum[j];
+      working_space[j + ssize] = spectrum[j];
+   }
+   BackgroundClippingSingle(working_space, average, prefix, ssize,
+                            numberIterations, direction, filterOrder,
+                            (smoothWindow - 1) / 2);
    if (compton == TRUE) {
-      for (i = 0, b2 = 0; i < ssize; i++){
-         b1 = b2;
-         a = working_space[i], b = spectrum[i];
-         j = i;
-         if (abs(a - b) >= 1) {
-            b1 = i - 1;
-            if (b1 < 0)
-               b1 = 0;
-            yb1 = working_space[b1];
-            for (b2 = b1 + 1, c = 0, priz = 0; priz == 0 && b2 < ssize; b2++){
-               a = working_space[b2], b = spectrum[b2];
-               c = c + b - yb1;
-               if (abs(a - b) < 1) {
-                  priz = 1;
-                  yb2 = b;
-               }
-            }
-            if (b2 == ssize)
-               b2 -= 1;
-            yb2 = working_space[b2];
-            if (yb1 <= yb2){
-               for (j = b1, c = 0; j <= b2; j++){
-                  b = spectrum[j];
-                  c = c + b - yb1;
-               }
-               if (c > 1){
-                  c = (yb2 - yb1) / c;
-                  for (j = b1, d = 0; j <= b2 && j < ssize; j++){
-                     b = spectrum[j];
-                     d = d + b - yb1;
-                     a = c * d + yb1;
-                     working_space[ssize + j] = a;
-                  }
-               }
-            }
-
-            else{
-               for (j = b2, c = 0; j >= b1; j--){
-                  b = spectrum[j];
-                  c = c + b - yb2;
-               }
-               if (c > 1){
-                  c = (yb1 - yb2) / c;
-                  for (j = b2, d = 0;j >= b1 && j >= 0; j--){
-                     b = spectrum[j];
-                     d = d + b - yb2;
-                     a = c * d + yb2;
-                     working_space[ssize + j] = a;
-                  }
-               }
-            }
-            i=b2;
-         }
+      source = SpectrumWorkspaceAlloc(ssize);
+      clipped = SpectrumWorkspaceAlloc(2 * (size_t) ssize);
+      if (source == NULL || clipped == NULL) {
+         SpectrumWorkspaceRelease(mark);
+         return "Not enough memory for working space";
+      }
+      for (j = 0; j < ssize; j++){
+         source[j] = spectrum[j];
+         clipped[j] = working_space[ssize + j];
+         clipped[j + ssize] = working_space[ssize + j];
       }
+      BackgroundCompton(source, clipped, ssize);
+      for (j = 0; j < ssize; j++)
+         background[j] = clipped[ssize + j];
    }
-   PROTECT(f = allocVector(REALSXP,ssize));
-   for (j = 0; j < ssize; j++){
-      REAL(f)[j] = working_space[ssize + j];
+
+   else{
+      for (j = 0; j < ssize; j++)
+         background[j] = working_space[ssize + j];
+   }
+   SpectrumWorkspaceRelease(mark);
+   return 0;
+}
+
+SEXP R_SpectrumBackground(SEXP R_spectrum,
+                                          SEXP R_numberIterations,
+                                          SEXP R_direction, SEXP R_filterOrder,
+                                          SEXP R_smoothing,SEXP R_smoothWindow,
+                                          SEXP R_compton, SEXP R_precision,
+                                          SEXP R_output)
+{
+/////////////////////////////////////////////////////////////////////////////
+//   Background of R_spectrum (numeric or integer vector or mapped file),  //
+//   R_precision kBackDoublePrecision or kBackSinglePrecision, the result  //
+//   goes to the file R_output unless it is NULL.                          //
+/////////////////////////////////////////////////////////////////////////////
+  const double * spectrum;
+  const float * single;
+  int numberIterations=INTEGER(R_numberIterations)[0];
+  int ssize;
+  int direction=INTEGER(R_direction)[0];
+  int filterOrder=INTEGER(R_filterOrder)[0];
+  int smoothing=INTEGER(R_smoothing)[0];
+  int smoothWindow=INTEGER(R_smoothWindow)[0];
+  int compton=INTEGER(R_compton)[0];
+  int precision=INTEGER(R_precision)[0];
+  const char *message;
+  SEXP f;
+   SpectrumWorkspaceReset();
+   if (precision == kBackSinglePrecision) {
+      single = SpectrumInputSingle(R_spectrum, &ssize);
+      PROTECT(f = SpectrumOutput(R_output, ssize, R_spectrum, R_NilValue));
+      message = SpectrumBackgroundSingle(single, SpectrumOutputData(f), ssize,
+                                         numberIterations, direction,
+                                         filterOrder, smoothing,
+                                         smoothWindow, compton);
+   }
+
+   else{
+      spectrum = SpectrumInput(R_spectrum, &ssize);
+      PROTECT(f = SpectrumOutput(R_output, ssize, R_spectrum, R_NilValue));
+      message = SpectrumBackground(spectrum, SpectrumOutputData(f), ssize,
+                                   numberIterations, direction, filterOrder,
+                                   smoothing, smoothWindow, compton);
    }
+   SpectrumWorkspaceReset();
+   if (message != 0)
+      Rf_error( "%s", message);
    UNPROTECT(1);
    return(f);
 }
 
+SEXP R_SpectrumBackgroundReach(SEXP R_numberIterations, SEXP R_smoothing,
+                               SEXP R_smoothWindow)
+{
+/////////////////////////////////////////////////////////////////////////////
+//        REACH OF THE CLIPPING OF A STREAMED SPECTRUM
+//
+//        the parameters are those of R_SpectrumBackground
+//
+//        Returns a list of the channels to the left and to the right of a
+//        channel its background depends on (see SpectrumBackgroundReach)
+//        and of the block (SNIP_BLOCK) the origin of a part must be a
+//        multiple of.
+//
+/////////////////////////////////////////////////////////////////////////////
+   ptrdiff_t left, right;
+   SEXP ans, ans_names;
+   SpectrumBackgroundReach(INTEGER(R_numberIterations)[0],
+                           INTEGER(R_smoothing)[0],
+                           INTEGER(R_smoothWindow)[0], &left, &right);
+   PROTECT(ans = allocVector(VECSXP, 3));
+   PROTECT(ans_names = allocVector(STRSXP, 3));
+   SET_VECTOR_ELT(ans, 0, ScalarReal((double) left));
+   SET_VECTOR_ELT(ans, 1, ScalarReal((double) right));
+   SET_VECTOR_ELT(ans, 2, ScalarReal(SNIP_BLOCK));
+   SET_STRING_ELT(ans_names, 0, mkChar("left"));
+   SET_STRING_ELT(ans_names, 1, mkChar("right"));
+   SET_STRING_ELT(ans_names, 2, mkChar("block"));
+   setAttrib(ans, R_NamesSymbol, ans_names);
+   UNPROTECT(2);
+   return ans;
+}
 
-SEXP R_SpectrumSmoothMarkov(SEXP R_source, SEXP R_averWindow)
+SEXP R_SpectrumBackgroundPart(SEXP R_spectrum, SEXP R_origin,
+                              SEXP R_numberIterations,
+                              SEXP R_direction, SEXP R_filterOrder,
+                              SEXP R_smoothing, SEXP R_smoothWindow)
+{
+/////////////////////////////////////////////////////////////////////////////
+//        BACKGROUND OF A CHUNK OF A STREAMED SPECTRUM
+//
+//        R_spectrum-the chunk
+//        R_origin-absolute (0-based) channel number of its first channel
+//        the other parameters are those of R_SpectrumBackground
+//
+//        Returns the background of the chunk, see SpectrumBackgroundPart.
+//
+/////////////////////////////////////////////////////////////////////////////
+   const char *message;
+   SEXP f;
+   PROTECT(f = allocVector(REALSXP, LENGTH(R_spectrum)));
+   SpectrumWorkspaceReset();
+   message = SpectrumBackgroundPart(REAL(R_spectrum), REAL(f),
+                                    LENGTH(R_spectrum),
+                                    (ptrdiff_t) REAL(R_origin)[0],
+                                    INTEGER(R_numberIterations)[0],
+                                    INTEGER(R_direction)[0],
+                                    INTEGER(R_filterOrder)[0],
+                                    INTEGER(R_smoothing)[0],
+                                    INTEGER(R_smoothWindow)[0]);
+   SpectrumWorkspaceReset();
+   if (message != 0)
+      Rf_error( "%s", message);
+   UNPROTECT(1);
+   return(f);
+}
+
+
+static const char *MarkovRatios(const double *s, double *dest, int ssize,
+                                int averWindow, int precision, int from,
+                                int to)
+{
+/////////////////////////////////////////////////////////////////////////////
+//   dest[j+1] = log(p(j,j+1)/p(j+1,j)) for from <= j < to. The pairs of    //
+//   the channels below from whose terms are needed in the ring are        //
+//   evaluated again, so every range gives the ratios of the whole         //
+//   spectrum exactly. The vectors are taken from the arena of the         //
+//   calling thread.                                                       //
+/////////////////////////////////////////////////////////////////////////////
+   int xmax = ssize - 1, i, j, d, k, count, m;
+   double sp, sm;
+   double *e, *reciprocal, *ring, *edge;
+   m = averWindow < ssize ? averWindow : ssize;
+   size_t mark = SpectrumWorkspaceMark();
+   e = SpectrumWorkspaceAlloc(m);
+   reciprocal = SpectrumWorkspaceAlloc(m);
+   ring = SpectrumWorkspaceAlloc(m);
+   edge = SpectrumWorkspaceAlloc(m);
+   if (e == NULL || reciprocal == NULL || ring == NULL || edge == NULL) {
+      SpectrumWorkspaceRelease(mark);
+      return "Not enough memory for working space";
+   }
+   for (d = 0; d < m; d++)
+      ring[d] = 0;
+   j = from + 1 - m;
+   if (j < 0)
+      j = 0;
+   for (; j < to; j++) {
+//terms of the pairs (j, j+d), the channels beyond xmax replaced by xmax
+      count = xmax - j;
+      if (count > averWindow)
+         count = averWindow;
+      SpectrumMarkovPairs(s, j, count, e, reciprocal, precision);
+//reciprocals, the terms from j+d+1 down to j, to the ring
+      k = (j + 1) % m;
+      i = m - k;
+      if (i > count)
+         i = count;
+      for (d = 0; d < i; d++)
+         ring[k + d] += reciprocal[d];
+      for (; d < count; d++)
+         ring[d - i] += reciprocal[d];
+      if (j == 0) {
+         for (d = 0; d < count; d++)
+            edge[d] = reciprocal[d];
+      }
+//all terms towards channel j+1 are complete, the channels below 0
+//replaced by 0
+      sm = ring[k];
+      ring[k] = 0;
+      if (j < from)
+         continue;
+      for (d = 0, sp = 0; d < count; d++)
+         sp += e[d];
+      if (count < averWindow)
+         sp += (averWindow - count) * e[count - 1];
+      if (j + 1 < averWindow)
+         sm += (averWindow - j - 1) * edge[j];
+      dest[j + 1] = log(sp / sm);
+   }
+   SpectrumWorkspaceRelease(mark);
+   return 0;
+}
+
+const char *SpectrumSmoothMarkov(const double *source, double *dest,
+                                 int ssize, int averWindow, int precision,
+                                 int threads)
 {
-  double * source=REAL(R_source);
-  int ssize=LENGTH(R_source);
-  int averWindow=INTEGER(R_averWindow)[0];
-  SEXP f;
 /////////////////////////////////////////////////////////////////////////////
 //        ONE-DIMENSIONAL MARKOV SPECTRUM SMOOTHING FUNCTION
 //
 //        This function calculates smoothed spectrum from source spectrum
 //        based on Markov chain method.
-//        The result is placed in the array pointed by source pointer.
+//        The result is placed in the vector pointed by dest pointer.
 //
 //        Function parameters:
-//        source-pointer to the array of source spectrum
-//        ssize-length of source array
+//        source-pointer to the vector of source spectrum
+//        dest-pointer to the vector of smoothed spectrum
+//        ssize-length of source vector
 //        averWindow-width of averaging smoothing window
+//        precision-kMarkovExact or kMarkovFast, see SpectrumMarkovPairs
+//        threads-number of OpenMP threads
+//
+//        The ratio p(i,i+1)/p(i+1,i) of the transition probabilities
+//        needs the term of every pair of channels at a distance below
+//        averWindow twice, once for each direction. Each term is
+//        evaluated once, when its lower channel is processed, and its
+//        reciprocal is accumulated for the upper channel in a ring of
+//        averWindow sums. The invariant distribution, a product of these
+//        ratios, is accumulated as a (compensated) sum of their
+//        logarithms, so it neither overflows nor underflows.
+//        If no channel is positive dest is a copy of source.
+//
+//        The spectrum is processed in blocks of MARKOV_BLOCK channels
+//        (at least 16 windows): the ratios of the blocks are independent,
+//        the sums of their logarithms are combined by a scan over the
+//        blocks. The blocks do not depend on the number of threads and
+//        neither does the result.
 //
 /////////////////////////////////////////////////////////////////////////////
-   int xmin = 0, xmax= ssize - 1, i, l;
-   double a, b, maxch;
-   double nom, nip, nim, sp, sm, area = 0;
-   if(averWindow <= 0)
-      Rf_error( "Averaging Window must be positive");
-   double working_space[ssize];
-   for(i = 0, maxch = 0; i < ssize; i++){
-      working_space[i]=0;
-      if(maxch < source[i])
+   int xmax = ssize - 1, i, c, nblock, block, m, failed = 0;
+   double maxch, area = 0, lda, ldb, ldc, nom;
+   double *s, *total, *peak, *part;
+   const char *message = 0;
+   if (averWindow <= 0)
+      return "Averaging Window must be positive";
+   if (ssize <= 0)
+      return "Wrong Parameters";
+   m = averWindow < ssize ? averWindow : ssize;
+   block = MARKOV_BLOCK;
+   if (block < 16 * m)
+      block = 16 * m;
+   nblock = xmax > 0 ? (xmax + block - 1) / block : 1;
+   size_t mark = SpectrumWorkspaceMark();
+   s = SpectrumWorkspaceAlloc(ssize);
+   total = SpectrumWorkspaceAlloc(nblock);
+   peak = SpectrumWorkspaceAlloc(nblock);
+   part = SpectrumWorkspaceAlloc(nblock);
+   if (s == NULL || total == NULL || peak == NULL || part == NULL) {
+      SpectrumWorkspaceRelease(mark);
+      return "Not enough memory for working space";
+   }
+   for (i = 0, maxch = 0; i < ssize; i++) {
+      if (maxch < source[i])
          maxch = source[i];
-
       area += source[i];
    }
-   if(maxch == 0)
-      return 0 ;
-
-   nom = 1;
-   working_space[xmin] = 1;
-   for(i = xmin; i < xmax; i++){
-      nip = source[i] / maxch;
-      nim = source[i + 1] / maxch;
-      sp = 0,sm = 0;
-      for(l = 1; l <= averWindow; l++){
-         if((i + l) > xmax)
-            a = source[xmax] / maxch;
-
-         else
-            a = source[i + l] / maxch;
-         b = a - nip;
-         if(a + nip <= 0)
-            a = 1;
-
-         else
-            a = sqrt(a + nip);
-         b = b / a;
-         b = exp(b);
-         sp = sp + b;
-         if((i - l + 1) < xmin)
-            a = source[xmin] / maxch;
-
-         else
-            a = source[i - l + 1] / maxch;
-         b = a - nim;
-         if(a + nim <= 0)
-            a = 1;
-         else
-            a = sqrt(a + nim);
-         b = b / a;
-         b = exp(b);
-         sm = sm + b;
+   if (maxch == 0) {
+      for (i = 0; i < ssize; i++)
+         dest[i] = source[i];
+      SpectrumWorkspaceRelease(mark);
+      return 0;
+   }
+   for (i = 0; i < ssize; i++)
+      s[i] = source[i] / maxch;
+
+//logarithms of the ratios, dest[j+1] for channel j
+   dest[0] = 0;
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(threads) schedule(dynamic)
+#endif
+   for (c = 0; c < nblock; c++) {
+      const char *error;
+      int from = c * block, to = from + block, stop;
+#ifdef _OPENMP
+#pragma omp atomic read
+#endif
+      stop = failed;
+      if (stop)
+         continue;
+      if (to > xmax)
+         to = xmax;
+      error = MarkovRatios(s, dest, ssize, averWindow, precision, from, to);
+      if (error != 0) {
+#ifdef _OPENMP
+#pragma omp critical(rPeaksBatchError)
+#endif
+         message = error;
+#ifdef _OPENMP
+#pragma omp atomic write
+#endif
+         failed = 1;
       }
-      a = sp / sm;
-      a = working_space[i + 1] = working_space[i] * a;
-      nom = nom + a;
    }
-   for(i = xmin; i <= xmax; i++){
-      working_space[i] = working_space[i] / nom;
+   if (message != 0) {
+      SpectrumWorkspaceRelease(mark);
+      return message;
    }
-   PROTECT(f = allocVector(REALSXP,ssize));
-   for (i = 0; i < ssize; i++){
-      REAL(f)[i] = working_space[i]*area;
+
+//compensated sums of the logarithms of every block, dest[lo..hi]
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(threads) private(i, lda, ldb, ldc)
+#endif
+   for (c = 0; c < nblock; c++) {
+      int lo = c * block + 1, hi = c * block + block;
+      if (hi > xmax)
+         hi = xmax;
+      for (i = lo, ldb = 0, ldc = 0; i <= hi; i++) {
+         lda = dest[i] - ldc;
+         ldc = (ldb + lda - ldb) - lda;
+         ldb = ldb + lda;
+      }
+      total[c] = ldb - ldc;
+   }
+//scan over the blocks, total[c] becomes the logarithm before block c
+   for (c = 0, ldb = 0, ldc = 0; c < nblock; c++) {
+      lda = total[c] - ldc;
+      total[c] = ldb;
+      ldc = (ldb + lda - ldb) - lda;
+      ldb = ldb + lda;
+   }
+//logarithm of the invariant distribution, dest[0] = log(1)
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(threads) private(i, lda, ldb, ldc)
+#endif
+   for (c = 0; c < nblock; c++) {
+      int lo = c * block + 1, hi = c * block + block;
+      if (hi > xmax)
+         hi = xmax;
+      peak[c] = c == 0 ? dest[0] : -HUGE_VAL;
+      for (i = lo, ldb = total[c], ldc = 0; i <= hi; i++) {
+         lda = dest[i] - ldc;
+         ldc = (ldb + lda - ldb) - lda;
+         ldb = ldb + lda;
+         dest[i] = ldb;
+         if (peak[c] < ldb)
+            peak[c] = ldb;
+      }
+   }
+
+//normalization
+   for (c = 1, lda = peak[0]; c < nblock; c++) {
+      if (lda < peak[c])
+         lda = peak[c];
+   }
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(threads) private(i, ldb)
+#endif
+   for (c = 0; c < nblock; c++) {
+      int lo = c == 0 ? 0 : c * block + 1, hi = c * block + block;
+      if (hi > xmax)
+         hi = xmax;
+      for (i = lo, ldb = 0; i <= hi; i++) {
+         dest[i] = exp(dest[i] - lda);
+         ldb += dest[i];
+      }
+      part[c] = ldb;
+   }
+   for (c = 0, nom = 0; c < nblock; c++)
+      nom += part[c];
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(threads) private(i)
+#endif
+   for (i = 0; i < ssize; i++)
+      dest[i] = dest[i] / nom * area;
+   SpectrumWorkspaceRelease(mark);
+   return 0;
+}
+
+SEXP R_SpectrumSmoothMarkov(SEXP R_source, SEXP R_averWindow,
+                            SEXP R_precision, SEXP R_threads,
+                            SEXP R_output)
+{
+  const double * source;
+  int ssize;
+  int averWindow=INTEGER(R_averWindow)[0];
+  int precision=INTEGER(R_precision)[0];
+  int threads=SpectrumThreads(INTEGER(R_threads)[0]);
+  const char *message;
+  int i;
+  SEXP f;
+
+   if(averWindow <= 0)
+      Rf_error( "Averaging Window must be positive");
+   SpectrumWorkspaceReset();
+   source = SpectrumInput(R_source, &ssize);
+   for (i = 0; i < ssize && source[i] <= 0; i++)
+      ;
+   if (i == ssize) {
+      SpectrumWorkspaceReset();
+      return R_NilValue;
    }
+   PROTECT(f = SpectrumOutput(R_output, ssize, R_source, R_NilValue));
+   message = SpectrumSmoothMarkov(source, SpectrumOutputData(f), ssize, averWindow,
+                                  precision, threads);
+   SpectrumWorkspaceReset();
+   if (message != 0)
+      Rf_error( "%s", message);
    UNPROTECT(1);
    return(f);
-
 }
 
 
-SEXP R_SpectrumDeconvolution(SEXP R_source, SEXP R_response,
-                                      SEXP R_numberIterations,
-                                      SEXP R_numberRepetitions, SEXP R_boost )
+const char *SpectrumResponsePrepare(SpectrumResponse *prepared,
+                                    const double *response, int ssize,
+                                    int engine)
 {
+/////////////////////////////////////////////////////////////////////////////
+//   PREPARATION OF THE RESPONSE FOR THE GOLD DECONVOLUTION                //
+//   Finds the length, maximum and area of the response and computes the  //
+//   vector at*a (and for the FFT engine the spectra of the response and  //
+//   of at*a) for spectra of ssize channels.                               //
+//                                                                         //
+//   Function parameters:                                                  //
+//   prepared: structure to fill, release it by SpectrumResponseFree       //
+//   response: pointer to the vector of response spectrum (ssize)          //
+//   ssize:    length of source and response spectra                       //
+//   engine, kEngineDirect, kEngineFFT or kEngineAuto                      //
+//                                                                         //
+/////////////////////////////////////////////////////////////////////////////
+   int i, j, k, lh_gold = -1, posit = 0;
+   double lda, ldb, ldc, area = 0, maximum = 0;
+   const char *message;
+   memset(prepared, 0, sizeof(SpectrumResponse));
+   if (ssize <= 0)
+      return "Wrong Parameters";
+//read response vector
+   for (i = 0; i < ssize; i++) {
+      lda = response[i];
+      if (lda != 0)
+         lh_gold = i + 1;
+      area += lda;
+      if (lda > maximum) {
+         maximum = lda;
+         posit = i;
+      }
+   }
+   if (lh_gold == -1)
+      return "ZERO RESPONSE VECTOR";
+   if (engine == kEngineAuto)
+      engine = SpectrumFFTPreferred(ssize, lh_gold) ? kEngineFFT : kEngineDirect;
+   prepared->ssize = ssize;
+   prepared->lh_gold = lh_gold;
+   prepared->posit = posit;
+   prepared->area = area;
+   prepared->engine = engine;
+   prepared->n = engine == kEngineFFT ? SpectrumFFTSize(ssize + lh_gold) : 0;
+   prepared->block = malloc((2 * (size_t) lh_gold + 2 * (size_t) prepared->n) * sizeof(double));
+   if (prepared->block == NULL)
+      return "Not enough memory for prepared response";
+   prepared->response = (double *) prepared->block;
+   prepared->ata = prepared->response + lh_gold;
+   for (i = 0; i < lh_gold; i++)
+      prepared->response[i] = response[i];
+   if (engine == kEngineFFT) {
+      prepared->spectrum = prepared->ata + lh_gold;
+      prepared->kernel = prepared->spectrum + prepared->n;
+      message = SpectrumResponseFFT(prepared);
+      if (message != 0) {
+         SpectrumResponseFree(prepared);
+         return message;
+      }
+   }
 
-  double *source = REAL(R_source);
-  double *response=REAL(R_response);
-  int ssize=LENGTH(R_source);
-  int numberIterations=INTEGER(R_numberIterations)[0];
-  int numberRepetitions=INTEGER(R_numberRepetitions)[0];
-  double boost=REAL(R_boost)[0];
-  SEXP f;
+   else{
+// create vector at*a
+      for (i = 0; i < lh_gold; i++){
+         lda = 0;
+         for (j = 0; j < lh_gold; j++){
+            ldb = prepared->response[j];
+            k = i + j;
+            if (k < lh_gold){
+               ldc = prepared->response[k];
+               lda = lda + ldb * ldc;
+            }
+         }
+         prepared->ata[i] = lda;
+      }
+   }
+   return 0;
+}
+
+void SpectrumResponseFree(SpectrumResponse *prepared)
+{
+   free(prepared->block);
+   memset(prepared, 0, sizeof(SpectrumResponse));
+}
+
+const char *SpectrumDeconvolutionGold(double *destination,
+                                      const double *source,
+                                      const SpectrumResponse *prepared,
+                                      int numberIterations,
+                                      int numberRepetitions, double boost,
+                                      int acceleration, const double *init,
+                                      SpectrumConvergence *conv)
+{
 /////////////////////////////////////////////////////////////////////////////
 //   ONE-DIMENSIONAL DECONVOLUTION FUNCTION                                //
 //   This function calculates deconvolution from source spectrum           //
 //   according to response spectrum using Gold algorithm                   //
-//   The result is placed in the vector pointed by source pointer.         //
+//   The result is placed in the vector pointed by destination pointer.    //
 //                                                                         //
 //   Function parameters:                                                  //
+//   destination: pointer to the vector of resulting spectrum              //
 //   source:  pointer to the vector of source spectrum                     //
-//   response:     pointer to the vector of response spectrum              //
-//   ssize:    length of source and response spectra                       //
+//   prepared: response prepared by SpectrumResponsePrepare, its ssize is  //
+//             the length of source and destination                        //
 //   numberIterations, for details we refer to the reference given below   //
 //   numberRepetitions, for repeated boosted deconvolution                 //
 //   boost, boosting coefficient                                           //
+//   acceleration, kAccelerationNone or kAccelerationBiggsAndrews          //
+//   init, previous result the iterations start from, or NULL to start    //
+//         from 1                                                          //
+//   conv, early stopping and its diagnostics, may be NULL                 //
 //                                                                         //
 //    M. Morhac, J. Kliman, V. Matousek, M. Veselsk?, I. Turzo.:           //
 //    Efficient one- and two-dimensional Gold deconvolution and its        //
@@ -884,164 +944,276 @@ SEXP R_SpectrumDeconvolution(SEXP R_source, SEXP R_response,
 //                                                                         //
 /////////////////////////////////////////////////////////////////////////////
 //
-
-   if (ssize <= 0)
-      Rf_error( "Wrong Parameters");
-
+   int ssize = prepared->ssize, lh_gold = prepared->lh_gold;
+   int posit = prepared->posit;
+   double area = prepared->area;
+   const char *message;
    if (numberRepetitions <= 0)
-      Rf_error( "Wrong Parameters ");
+      return "Wrong Parameters ";
 
        //   working_space-pointer to the working vector
        //   (its size must be 4*ssize of source spectrum)
-   double working_space[4 * ssize];
-   int i, j, k, lindex, posit = 0, lh_gold = -1, l, repet;
-   double lda, ldb, ldc, area=0, maximum=0;
-//read response vector
-   for (i = 0; i < ssize; i++) {
-      lda = response[i];
-      if (lda != 0)
-         lh_gold = i + 1;
-      working_space[i] = lda;
-      area += lda;
-      if (lda > maximum) {
-         maximum = lda;
-         posit = i;
+   size_t mark = SpectrumWorkspaceMark();
+   double *working_space = SpectrumWorkspaceAlloc(4 * (size_t) ssize);
+   SpectrumAcceleration accelerator, *acc = NULL;
+   if (working_space == NULL)
+      return "Not enough memory for working space";
+   if (acceleration == kAccelerationBiggsAndrews) {
+      acc = &accelerator;
+      if (SpectrumAccelerationInit(acc, ssize) != 0) {
+         SpectrumWorkspaceRelease(mark);
+         return "Not enough memory for working space";
       }
    }
-   if (lh_gold == -1)
-      Rf_error( "ZERO RESPONSE VECTOR" );
+   int i, j, k, lindex, l, repet, stop;
+   double lda, ldb, ldc;
 
-//read source vector
-   for (i = 0; i < ssize; i++)
-      working_space[2 * ssize + i] = source[i];
+//initialization of resulting vector
+   SpectrumDeconvolutionStart(working_space, init, ssize, posit, area);
+   if (prepared->engine == kEngineFFT) {
+      message = SpectrumDeconvolutionGoldFFT(working_space, source, prepared,
+                                             numberIterations,
+                                             numberRepetitions, boost, conv,
+                                             acc);
+      if (message != 0) {
+         SpectrumWorkspaceRelease(mark);
+         return message;
+      }
+   }
 
-// create matrix at*a and vector at*y
-   for (i = 0; i < ssize; i++){
-      lda = 0;
-      for (j = 0; j < ssize; j++){
-         ldb = working_space[j];
-         k = i + j;
-         if (k < ssize){
-            ldc = working_space[k];
-            lda = lda + ldb * ldc;
-         }
+   else{
+//read source vector and vector at*a
+      for (i = 0; i < ssize; i++){
+         working_space[2 * ssize + i] = source[i];
+         working_space[ssize + i] = i < lh_gold ? prepared->ata[i] : 0;
       }
-      working_space[ssize + i] = lda;
-      lda = 0;
-      for (k = 0; k < ssize; k++){
-         l = k - i;
-         if (l >= 0){
-            ldb = working_space[l];
-            ldc = working_space[2 * ssize + k];
-            lda = lda + ldb * ldc;
+
+// create vector at*y
+      for (i = 0; i < ssize; i++){
+         lda = 0;
+         for (k = i; k < ssize && k < i + lh_gold; k++){
+            l = k - i;
+            if (l >= 0){
+               ldb = prepared->response[l];
+               ldc = working_space[2 * ssize + k];
+               lda = lda + ldb * ldc;
+            }
          }
+         working_space[3 * ssize + i]=lda;
       }
-      working_space[3 * ssize + i]=lda;
-   }
 
 // move vector at*y
-   for (i = 0; i < ssize; i++){
-      working_space[2 * ssize + i] = working_space[3 * ssize + i];
-   }
+      for (i = 0; i < ssize; i++){
+         working_space[2 * ssize + i] = working_space[3 * ssize + i];
+      }
 
-//initialization of resulting vector
-   for (i = 0; i < ssize; i++)
-      working_space[i] = 1;
+//channels started at 0 are not updated and keep their value
+      for (i = 0; i < ssize; i++)
+         if (working_space[i] <= 0.000001)
+            working_space[3 * ssize + i] = working_space[i];
 
        //**START OF ITERATIONS**
-   for (repet = 0; repet < numberRepetitions; repet++) {
-      if (repet != 0) {
-         for (i = 0; i < ssize; i++)
-            working_space[i] = pow(working_space[i], boost);
-      }
-      for (lindex = 0; lindex < numberIterations; lindex++) {
-         for (i = 0; i < ssize; i++) {
-            if (working_space[2 * ssize + i] > 0.000001
-                 && working_space[i] > 0.000001) {
-               lda = 0;
-               for (j = 0; j < lh_gold; j++) {
-                  ldb = working_space[j + ssize];
-                  if (j != 0){
-                     k = i + j;
-                     ldc = 0;
-                     if (k < ssize)
-                        ldc = working_space[k];
-                     k = i - j;
-                     if (k >= 0)
-                        ldc += working_space[k];
+      for (repet = 0; repet < numberRepetitions; repet++) {
+         if (repet != 0) {
+            for (i = 0; i < ssize; i++)
+               working_space[i] = pow(working_space[i], boost);
+         }
+         if (acc != NULL)
+            SpectrumAccelerationStart(acc, working_space);
+         for (lindex = 0; lindex < numberIterations; lindex++) {
+            for (i = 0; i < ssize; i++) {
+               if (working_space[2 * ssize + i] > 0.000001
+                    && working_space[i] > 0.000001) {
+                  lda = 0;
+                  for (j = 0; j < lh_gold; j++) {
+                     ldb = working_space[j + ssize];
+                     if (j != 0){
+                        k = i + j;
+                        ldc = 0;
+                        if (k < ssize)
+                           ldc = working_space[k];
+                        k = i - j;
+                        if (k >= 0)
+                           ldc += working_space[k];
+                     }
+
+                     else
+                        ldc = working_space[i];
+                     lda = lda + ldb * ldc;
                   }
+                  ldb = working_space[2 * ssize + i];
+                  if (lda != 0)
+                     lda = ldb / lda;
 
                   else
-                     ldc = working_space[i];
-                  lda = lda + ldb * ldc;
+                     lda = 0;
+                  ldb = working_space[i];
+                  lda = lda * ldb;
+                  working_space[3 * ssize + i] = lda;
                }
-               ldb = working_space[2 * ssize + i];
-               if (lda != 0)
-                  lda = ldb / lda;
-
-               else
-                  lda = 0;
-               ldb = working_space[i];
-               lda = lda * ldb;
-               working_space[3 * ssize + i] = lda;
             }
+            stop = SpectrumIterationNext(conv, acc, repet, lindex,
+                                         lindex == numberIterations - 1,
+                                         working_space,
+                                         working_space + 3 * ssize, ssize);
+            if (stop)
+               break;
          }
-         for (i = 0; i < ssize; i++)
-            working_space[i] = working_space[3 * ssize + i];
       }
    }
 
 //shift and write back resulting spectrum
-PROTECT(f = allocVector(REALSXP,ssize));
    for (i = 0; i < ssize; i++) {
       lda = working_space[i];
       j = i + posit;
       j = j % ssize;
-      REAL(f)[j] = lda*area;
+      destination[j] = lda*area;
    }
-UNPROTECT(1);
-   return(f);
+   SpectrumWorkspaceRelease(mark);
+   return 0;
+}
+
+static void DeconvolutionDiagnostics(SEXP f, SEXP iterations,
+                                     SEXP change)
+{
+//attributes "iterations" and "change" of a deconvolved spectrum
+   setAttrib(f, install("iterations"), iterations);
+   setAttrib(f, install("change"), change);
 }
 
-SEXP R_SpectrumDeconvolutionRL(SEXP R_source, SEXP R_response,
+SEXP R_SpectrumDeconvolution(SEXP R_source, SEXP R_response,
                                       SEXP R_numberIterations,
-                                      SEXP R_numberRepetitions, SEXP R_boost )
+                                      SEXP R_numberRepetitions, SEXP R_boost,
+                                      SEXP R_engine, SEXP R_tol,
+                                      SEXP R_acceleration, SEXP R_init,
+                                      SEXP R_output )
 {
+/////////////////////////////////////////////////////////////////////////////
+//   Gold deconvolution of R_source. R_response is either the response    //
+//   spectrum (of the length of R_source), prepared here for this call    //
+//   only, or a response prepared by R_SpectrumPrepareResponse.            //
+//   R_tol is the relative change stopping a repetition (0 = never),       //
+//   R_acceleration kAccelerationNone or kAccelerationBiggsAndrews.        //
+//   The iterations start from the previous result R_init unless it is    //
+//   NULL. The result goes to the file R_output unless it is NULL.         //
+/////////////////////////////////////////////////////////////////////////////
 
-  double *source = REAL(R_source);
-  double *response=REAL(R_response);
-  int ssize=LENGTH(R_source);
+  const double *source, *init = NULL;
+  int ssize;
   int numberIterations=INTEGER(R_numberIterations)[0];
   int numberRepetitions=INTEGER(R_numberRepetitions)[0];
   double boost=REAL(R_boost)[0];
-  SEXP f;
+  int engine=INTEGER(R_engine)[0];
+  int acceleration=INTEGER(R_acceleration)[0];
+  SpectrumResponse response, *prepared = &response;
+  SpectrumConvergence conv;
+  const char *message;
+  int i;
+  SEXP f, iterations, change;
+
+   SpectrumWorkspaceReset();
+   source = SpectrumInput(R_source, &ssize);
+   if (ssize <= 0 || numberRepetitions <= 0)
+      Rf_error( "Wrong Parameters");
+   if (R_init != R_NilValue) {
+      init = SpectrumInput(R_init, &i);
+      if (i != ssize)
+         Rf_error( "Initial estimate must have the length of the spectrum");
+   }
+   if (TYPEOF(R_response) == EXTPTRSXP) {
+      if (R_ExternalPtrTag(R_response) != install("rPeaksResponse"))
+         Rf_error( "Not a prepared response");
+      prepared = (SpectrumResponse *) R_ExternalPtrAddr(R_response);
+      if (prepared == NULL)
+         Rf_error( "Prepared response is no longer valid");
+      if (prepared->ssize != ssize)
+         Rf_error( "Response was prepared for spectra of %d channels", prepared->ssize);
+   }
+
+   else if (LENGTH(R_response) != ssize)
+      Rf_error( "Wrong Parameters");
+   PROTECT(f = SpectrumOutput(R_output, ssize, R_source, R_init));
+   PROTECT(iterations = allocVector(INTSXP,numberRepetitions));
+   PROTECT(change = allocVector(REALSXP,numberRepetitions));
+   if (TYPEOF(R_response) != EXTPTRSXP) {
+      message = SpectrumResponsePrepare(&response, REAL(R_response), ssize, engine);
+      if (message != 0)
+         Rf_error( "%s", message);
+   }
+   for (i = 0; i < numberRepetitions; i++) {
+      INTEGER(iterations)[i] = 0;
+      REAL(change)[i] = NA_REAL;
+   }
+   conv.tol = REAL(R_tol)[0];
+   conv.iterations = INTEGER(iterations);
+   conv.change = REAL(change);
+//source and init may be in the arena, so it is not reset here
+   message = SpectrumDeconvolutionGold(SpectrumOutputData(f), source, prepared,
+                                       numberIterations, numberRepetitions,
+                                       boost, acceleration, init, &conv);
+   SpectrumWorkspaceReset();
+   if (prepared == &response)
+      SpectrumResponseFree(&response);
+   if (message != 0)
+      Rf_error( "%s", message);
+   DeconvolutionDiagnostics(f, iterations, change);
+   UNPROTECT(3);
+   return(f);
+}
+
+const char *SpectrumDeconvolutionRL(double *destination, const double *source,
+                                    const double *response, int ssize,
+                                    int engine, int numberIterations,
+                                    int numberRepetitions, double boost,
+                                    int acceleration, const double *init,
+                                    SpectrumConvergence *conv)
+{
 /////////////////////////////////////////////////////////////////////////////
 //   ONE-DIMENSIONAL DECONVOLUTION FUNCTION                                //
 //   This function calculates deconvolution from source spectrum           //
 //   according to response spectrum using Richardson-Lucy algorithm        //
-//   The result is placed in the vector pointed by source pointer.         //
+//   The result is placed in the vector pointed by destination pointer.    //
 //                                                                         //
 //   Function parameters:                                                  //
+//   destination: pointer to the vector of resulting spectrum              //
 //   source:  pointer to the vector of source spectrum                     //
 //   response:     pointer to the vector of response spectrum              //
 //   ssize:    length of source and response spectra                       //
 //   numberIterations, for details we refer to the reference given above   //
 //   numberRepetitions, for repeated boosted deconvolution                 //
 //   boost, boosting coefficient                                           //
+//   engine, kEngineDirect, kEngineFFT (convolutions by FFT) or            //
+//           kEngineAuto (chosen from ssize and length of the response)    //
+//   acceleration, kAccelerationNone or kAccelerationBiggsAndrews          //
+//   init, previous result the iterations start from, or NULL to start    //
+//         from 1                                                          //
+//   conv, early stopping and its diagnostics, may be NULL                 //
 //                                                                         //
 /////////////////////////////////////////////////////////////////////////////
 //
 
+   const char *message;
    if (ssize <= 0)
-      Rf_error( "Wrong Parameters");
+      return "Wrong Parameters";
 
    if (numberRepetitions <= 0)
-      Rf_error( "Wrong Parameters");
+      return "Wrong Parameters";
 
        //   working_space-pointer to the working vector
-       //   (its size must be 4*ssize of source spectrum)
-   double working_space[4 * ssize];
-   int i, j, k, lindex, posit, lh_gold, repet, kmin, kmax;
+       //   (its size must be 5*ssize of source spectrum)
+   size_t mark = SpectrumWorkspaceMark();
+   double *working_space = SpectrumWorkspaceAlloc(5 * (size_t) ssize);
+   SpectrumAcceleration accelerator, *acc = NULL;
+   if (working_space == NULL)
+      return "Not enough memory for working space";
+   if (acceleration == kAccelerationBiggsAndrews) {
+      acc = &accelerator;
+      if (SpectrumAccelerationInit(acc, ssize) != 0) {
+         SpectrumWorkspaceRelease(mark);
+         return "Not enough memory for working space";
+      }
+   }
+   int i, j, k, lindex, posit, lh_gold, repet, kmin, kmax, stop;
    double lda, ldb, ldc, maximum;
    lh_gold = -1;
    posit = 0;
@@ -1058,82 +1230,154 @@ SEXP R_SpectrumDeconvolutionRL(SEXP R_source, SEXP R_response,
          posit = i;
       }
    }
-   if (lh_gold == -1)
-      Rf_error( "ZERO RESPONSE VECTOR");
+   if (lh_gold == -1) {
+      SpectrumWorkspaceRelease(mark);
+      return "ZERO RESPONSE VECTOR";
+   }
 
 //read source vector
    for (i = 0; i < ssize; i++)
       working_space[2 * ssize + i] = source[i];
 
 //initialization of resulting vector
+   SpectrumDeconvolutionStart(working_space, init, ssize, posit, 1);
    for (i = 0; i < ssize; i++){
-      if (i <= ssize - lh_gold)
-         working_space[i] = 1;
-
-      else
+      if (i > ssize - lh_gold)
          working_space[i] = 0;
 
+      working_space[3 * ssize + i] = working_space[i];
    }
-       //**START OF ITERATIONS**
-   for (repet = 0; repet < numberRepetitions; repet++) {
-      if (repet != 0) {
-         for (i = 0; i < ssize; i++)
-            working_space[i] = pow(working_space[i], boost);
+   if (engine == kEngineAuto)
+      engine = SpectrumFFTPreferred(ssize, lh_gold) ? kEngineFFT : kEngineDirect;
+   if (engine == kEngineFFT) {
+      message = SpectrumDeconvolutionRLFFT(working_space, ssize, lh_gold,
+                                           numberIterations,
+                                           numberRepetitions, boost, conv,
+                                           acc);
+      if (message != 0) {
+         SpectrumWorkspaceRelease(mark);
+         return message;
       }
-      for (lindex = 0; lindex < numberIterations; lindex++) {
-         for (i = 0; i <= ssize - lh_gold; i++){
-            lda = 0;
-            if (working_space[i] > 0){//x[i]
-               for (j = i; j < i + lh_gold; j++){
-                  ldb = working_space[2 * ssize + j];//y[j]
-                  if (j < ssize){
-                     if (ldb > 0){//y[j]
-                        kmax = j;
-                        if (kmax > lh_gold - 1)
-                           kmax = lh_gold - 1;
-                        kmin = j + lh_gold - ssize;
-                        if (kmin < 0)
-                           kmin = 0;
-                        ldc = 0;
-                        for (k = kmax; k >= kmin; k--){
-                           ldc += working_space[ssize + k] * working_space[j - k];//h[k]*x[j-k]
-                        }
-                        if (ldc > 0)
-                           ldb = ldb / ldc;
-
-                        else
-                           ldb = 0;
-                     }
-                     ldb = ldb * working_space[ssize + j - i];//y[j]*h[j-i]/suma(h[j][k]x[k])
+   }
+
+   else{
+       //**START OF ITERATIONS**
+      for (repet = 0; repet < numberRepetitions; repet++) {
+         if (repet != 0) {
+            for (i = 0; i < ssize; i++)
+               working_space[i] = pow(working_space[i], boost);
+         }
+         if (acc != NULL)
+            SpectrumAccelerationStart(acc, working_space);
+         for (lindex = 0; lindex < numberIterations; lindex++) {
+//forward model h*x and ratio y/(h*x), evaluated once per channel
+            for (j = 0; j < ssize; j++){
+               ldb = working_space[2 * ssize + j];//y[j]
+               if (ldb > 0){//y[j]
+                  kmax = j;
+                  if (kmax > lh_gold - 1)
+                     kmax = lh_gold - 1;
+                  kmin = j + lh_gold - ssize;
+                  if (kmin < 0)
+                     kmin = 0;
+                  ldc = 0;
+                  for (k = kmax; k >= kmin; k--){
+                     ldc += working_space[ssize + k] * working_space[j - k];//h[k]*x[j-k]
                   }
-                  lda += ldb;
+                  if (ldc > 0)
+                     ldb = ldb / ldc;
+
+                  else
+                     ldb = 0;
+               }
+               working_space[4 * ssize + j] = ldb;
+            }
+            for (i = 0; i <= ssize - lh_gold; i++){
+               lda = 0;
+               if (working_space[i] > 0){//x[i]
+                  for (j = i; j < i + lh_gold; j++){
+                     ldb = working_space[4 * ssize + j] * working_space[ssize + j - i];//y[j]*h[j-i]/suma(h[j][k]x[k])
+                     lda += ldb;
+                  }
+                  lda = lda * working_space[i];
                }
-               lda = lda * working_space[i];
+               working_space[3 * ssize + i] = lda;
             }
-            working_space[3 * ssize + i] = lda;
+            stop = SpectrumIterationNext(conv, acc, repet, lindex,
+                                         lindex == numberIterations - 1,
+                                         working_space,
+                                         working_space + 3 * ssize, ssize);
+            if (stop)
+               break;
          }
-         for (i = 0; i < ssize; i++)
-            working_space[i] = working_space[3 * ssize + i];
       }
    }
 
 //shift and write back resulting spectrum
-PROTECT(f = allocVector(REALSXP,ssize));
    for (i = 0; i < ssize; i++) {
       lda = working_space[i];
       j = i + posit;
       j = j % ssize;
-      REAL(f)[j] = lda;
+      destination[j] = lda;
    }
-   UNPROTECT(1);
+   SpectrumWorkspaceRelease(mark);
+   return 0;
+}
+
+SEXP R_SpectrumDeconvolutionRL(SEXP R_source, SEXP R_response,
+                                      SEXP R_numberIterations,
+                                      SEXP R_numberRepetitions, SEXP R_boost,
+                                      SEXP R_engine, SEXP R_tol,
+                                      SEXP R_acceleration, SEXP R_init,
+                                      SEXP R_output )
+{
+
+  const double *source, *init = NULL;
+  double *response=REAL(R_response);
+  int ssize;
+  int numberIterations=INTEGER(R_numberIterations)[0];
+  int numberRepetitions=INTEGER(R_numberRepetitions)[0];
+  double boost=REAL(R_boost)[0];
+  int engine=INTEGER(R_engine)[0];
+  int acceleration=INTEGER(R_acceleration)[0];
+  SpectrumConvergence conv;
+  const char *message;
+  int i;
+  SEXP f, iterations, change;
+
+   SpectrumWorkspaceReset();
+   source = SpectrumInput(R_source, &ssize);
+   if (numberRepetitions <= 0 || LENGTH(R_response) != ssize)
+      Rf_error( "Wrong Parameters");
+   if (R_init != R_NilValue) {
+      init = SpectrumInput(R_init, &i);
+      if (i != ssize)
+         Rf_error( "Initial estimate must have the length of the spectrum");
+   }
+   PROTECT(f = SpectrumOutput(R_output, ssize, R_source, R_init));
+   PROTECT(iterations = allocVector(INTSXP,numberRepetitions));
+   PROTECT(change = allocVector(REALSXP,numberRepetitions));
+   for (i = 0; i < numberRepetitions; i++) {
+      INTEGER(iterations)[i] = 0;
+      REAL(change)[i] = NA_REAL;
+   }
+   conv.tol = REAL(R_tol)[0];
+   conv.iterations = INTEGER(iterations);
+   conv.change = REAL(change);
+   message = SpectrumDeconvolutionRL(SpectrumOutputData(f), source, response, ssize, engine,
+                                     numberIterations, numberRepetitions,
+                                     boost, acceleration, init, &conv);
+   SpectrumWorkspaceReset();
+   if (message != 0)
+      Rf_error( "%s", message);
+   DeconvolutionDiagnostics(f, iterations, change);
+   UNPROTECT(3);
    return(f);
 }
 
-const char *SpectrumUnfolding(double *source,
-                                               const double **respMatrix,
-                                               int ssizex, int ssizey,
-                                               int numberIterations,
-                                               int numberRepetitions, double boost)
+const char *SpectrumUnfolding(double *source, const double *respMatrix,
+                              int ssizex, int ssizey, int numberIterations,
+                              int numberRepetitions, double boost)
 {
 /////////////////////////////////////////////////////////////////////////////
 //        ONE-DIMENSIONAL UNFOLDING FUNCTION
@@ -1143,171 +1387,318 @@ const char *SpectrumUnfolding(double *source,
 //
 //        Function parameters:
 //        source-pointer to the vector of source spectrum
-//        respMatrix-pointer to the matrix of response spectra
-//        ssizex-length of source spectrum and # of columns of response matrix
-//        ssizey-length of destination spectrum and # of rows of
+//        respMatrix-pointer to the matrix of response spectra, stored by
+//                   columns (as R does), column j is the response
+//                   spectrum of channel j and has ssizex elements
+//        ssizex-length of source spectrum and # of rows of response matrix
+//        ssizey-length of destination spectrum and # of columns of
 //              response matrix
 //        numberIterations, for details we refer to manual
 //        Note!!! ssizex must be >= ssizey
+//
+//        The matrix products at*a, at*y, (at*a)*(at*a) and (at*a)*(at*y)
+//        are computed by BLAS from the unnormalized response matrix, which
+//        is neither copied nor modified; the normalization of the columns
+//        to unit area is applied to the products.
 /////////////////////////////////////////////////////////////////////////////
-   int i, j, k, lindex, lhx = 0, repet;
-   double lda, ldb, ldc, area;
+   int i, j, lindex, lhx, repet, one = 1;
+   double lda, ldb, area, alpha = 1, beta = 0;
+   double *ata, *ata2, *scale, *aty, *x, *y;
    if (ssizex <= 0 || ssizey <= 0)
       return "Wrong Parameters";
    if (ssizex < ssizey)
       return "Sizex must be greater than sizey)";
    if (numberIterations <= 0)
       return "Number of iterations must be positive";
-   double working_space[ssizex * ssizey + 2 * ssizey * ssizey + 4 * ssizex];
 
-/*read response matrix*/
-   for (j = 0; j < ssizey && lhx != -1; j++) {
+   size_t mark = SpectrumWorkspaceMark();
+   ata = SpectrumWorkspaceAlloc((size_t) ssizey * ssizey);
+   ata2 = SpectrumWorkspaceAlloc((size_t) ssizey * ssizey);
+   scale = SpectrumWorkspaceAlloc(ssizey);
+   aty = SpectrumWorkspaceAlloc(ssizey);
+   x = SpectrumWorkspaceAlloc(ssizey);
+   y = SpectrumWorkspaceAlloc(ssizey);
+   if (ata == NULL || ata2 == NULL || scale == NULL || aty == NULL || x == NULL || y == NULL) {
+      SpectrumWorkspaceRelease(mark);
+      return "Not enough memory for working space";
+   }
+
+/*areas of response columns*/
+   for (j = 0; j < ssizey; j++) {
       area = 0;
       lhx = -1;
       for (i = 0; i < ssizex; i++) {
-         lda = respMatrix[j][i];
-         if (lda != 0) {
+         lda = respMatrix[(size_t) j * ssizex + i];
+         if (lda != 0)
             lhx = i + 1;
-         }
-         working_space[j * ssizex + i] = lda;
          area = area + lda;
       }
-      if (lhx != -1) {
-         for (i = 0; i < ssizex; i++)
-            working_space[j * ssizex + i] /= area;
+      if (lhx == -1) {
+         SpectrumWorkspaceRelease(mark);
+         return ("ZERO COLUMN IN RESPONSE MATRIX");
       }
+      scale[j] = 1 / area;
    }
-   if (lhx == -1)
-      return ("ZERO COLUMN IN RESPONSE MATRIX");
-
-/*read source vector*/
-   for (i = 0; i < ssizex; i++)
-      working_space[ssizex * ssizey + 2 * ssizey * ssizey + 2 * ssizex + i] =
-          source[i];
 
 /*create matrix at*a + at*y */
-   for (i = 0; i < ssizey; i++) {
-      for (j = 0; j < ssizey; j++) {
-         lda = 0;
-         for (k = 0; k < ssizex; k++) {
-            ldb = working_space[ssizex * i + k];
-            ldc = working_space[ssizex * j + k];
-            lda = lda + ldb * ldc;
-         }
-         working_space[ssizex * ssizey + ssizey * i + j] = lda;
-      }
-      lda = 0;
-      for (k = 0; k < ssizex; k++) {
-         ldb = working_space[ssizex * i + k];
-         ldc =
-             working_space[ssizex * ssizey + 2 * ssizey * ssizey + 2 * ssizex +
-                           k];
-         lda = lda + ldb * ldc;
+   F77_CALL(dsyrk)("U", "T", &ssizey, &ssizex, &alpha, respMatrix, &ssizex,
+                   &beta, ata, &ssizey FCONE FCONE);
+   F77_CALL(dgemv)("T", &ssizex, &ssizey, &alpha, respMatrix, &ssizex,
+                   source, &one, &beta, aty, &one FCONE);
+   for (j = 0; j < ssizey; j++) {
+      for (i = 0; i <= j; i++) {
+         lda = ata[(size_t) j * ssizey + i] * scale[i] * scale[j];
+         ata[(size_t) j * ssizey + i] = lda;
+         ata[(size_t) i * ssizey + j] = lda;
       }
-      working_space[ssizex * ssizey + 2 * ssizey * ssizey + 3 * ssizex + i] =
-          lda;
+      aty[j] *= scale[j];
    }
 
-/*move vector at*y*/
-   for (i = 0; i < ssizey; i++)
-      working_space[ssizex * ssizey + 2 * ssizey * ssizey + 2 * ssizex + i] =
-          working_space[ssizex * ssizey + 2 * ssizey * ssizey + 3 * ssizex + i];
-
 /*create matrix at*a*at*a + vector at*a*at*y */
-   for (i = 0; i < ssizey; i++) {
-      for (j = 0; j < ssizey; j++) {
-         lda = 0;
-         for (k = 0; k < ssizey; k++) {
-            ldb = working_space[ssizex * ssizey + ssizey * i + k];
-            ldc = working_space[ssizex * ssizey + ssizey * j + k];
-            lda = lda + ldb * ldc;
-         }
-         working_space[ssizex * ssizey + ssizey * ssizey + ssizey * i + j] =
-             lda;
-      }
-      lda = 0;
-      for (k = 0; k < ssizey; k++) {
-         ldb = working_space[ssizex * ssizey + ssizey * i + k];
-         ldc =
-             working_space[ssizex * ssizey + 2 * ssizey * ssizey + 2 * ssizex +
-                           k];
-         lda = lda + ldb * ldc;
-      }
-      working_space[ssizex * ssizey + 2 * ssizey * ssizey + 3 * ssizex + i] =
-          lda;
-   }
-
-/*move at*a*at*y*/
+   F77_CALL(dsyrk)("U", "T", &ssizey, &ssizey, &alpha, ata, &ssizey,
+                   &beta, ata2, &ssizey FCONE FCONE);
+   F77_CALL(dsymv)("U", &ssizey, &alpha, ata, &ssizey, aty, &one,
+                   &beta, y, &one FCONE);
    for (i = 0; i < ssizey; i++)
-      working_space[ssizex * ssizey + 2 * ssizey * ssizey + 2 * ssizex + i] =
-          working_space[ssizex * ssizey + 2 * ssizey * ssizey + 3 * ssizex + i];
+      aty[i] = y[i];
 
 /*initialization in resulting vector */
    for (i = 0; i < ssizey; i++)
-      working_space[ssizex * ssizey + 2 * ssizey * ssizey + i] = 1;
+      x[i] = 1;
 
         /***START OF ITERATIONS***/
    for (repet = 0; repet < numberRepetitions; repet++) {
       if (repet != 0) {
          for (i = 0; i < ssizey; i++)
-            working_space[ssizex * ssizey + 2 * ssizey * ssizey + i] = pow(working_space[ssizex * ssizey + 2 * ssizey * ssizey + i], boost);
+            x[i] = pow(x[i], boost);
       }
       for (lindex = 0; lindex < numberIterations; lindex++) {
+         F77_CALL(dsymv)("U", &ssizey, &alpha, ata2, &ssizey, x, &one,
+                         &beta, y, &one FCONE);
          for (i = 0; i < ssizey; i++) {
-            lda = 0;
-            for (j = 0; j < ssizey; j++) {
-               ldb =
-                   working_space[ssizex * ssizey + ssizey * ssizey + ssizey * i + j];
-               ldc = working_space[ssizex * ssizey + 2 * ssizey * ssizey + j];
-               lda = lda + ldb * ldc;
-            }
-            ldb =
-                working_space[ssizex * ssizey + 2 * ssizey * ssizey + 2 * ssizex + i];
+            lda = y[i];
+            ldb = aty[i];
             if (lda != 0) {
                lda = ldb / lda;
             }
 
             else
                lda = 0;
-            ldb = working_space[ssizex * ssizey + 2 * ssizey * ssizey + i];
+            ldb = x[i];
             lda = lda * ldb;
-            working_space[ssizex * ssizey + 2 * ssizey * ssizey + 3 * ssizex + i] = lda;
+            y[i] = lda;
          }
          for (i = 0; i < ssizey; i++)
-            working_space[ssizex * ssizey + 2 * ssizey * ssizey + i] =
-                working_space[ssizex * ssizey + 2 * ssizey * ssizey + 3 * ssizex + i];
+            x[i] = y[i];
       }
    }
 
 /*write back resulting spectrum*/
    for (i = 0; i < ssizex; i++) {
       if (i < ssizey)
-         source[i] = working_space[ssizex * ssizey + 2 * ssizey * ssizey + i];
+         source[i] = x[i];
 
       else
          source[i] = 0;
    }
+   SpectrumWorkspaceRelease(mark);
    return 0;
 }
 
-SEXP R_SpectrumSearchHighRes(SEXP R_source,
-                                     SEXP R_sigma, SEXP R_threshold,
-                                     SEXP  R_backgroundRemove, SEXP R_deconIterations,
-                                     SEXP  R_markov, SEXP  R_averWindow)
+SEXP R_SpectrumUnfolding(SEXP R_source, SEXP R_respMatrix,
+                         SEXP R_numberIterations, SEXP R_numberRepetitions,
+                         SEXP R_boost)
 {
-     double *source=REAL(R_source);
-     int ssize=LENGTH(R_source);
-     double sigma=REAL(R_sigma)[0];
-     double threshold=REAL(R_threshold)[0];
-     int backgroundRemove=INTEGER(R_backgroundRemove)[0];
-     int deconIterations=INTEGER(R_deconIterations)[0];
-     int markov=INTEGER(R_markov)[0];
-     int averWindow=INTEGER(R_averWindow)[0];
-     int fMaxPeaks=ssize;
-     int fNPeaks;
-     double fPositionX[fMaxPeaks];
-     SEXP destVector,f,ans,ans_names;
+   int ssizex = nrows(R_respMatrix);
+   int ssizey = ncols(R_respMatrix);
+   int numberIterations = INTEGER(R_numberIterations)[0];
+   int numberRepetitions = INTEGER(R_numberRepetitions)[0];
+   double boost = REAL(R_boost)[0];
+   const char *message;
+   double *source;
+   int i;
+   SEXP f;
+   if (LENGTH(R_source) != ssizex)
+      Rf_error( "Length of source spectrum must equal the number of rows of response matrix");
+   SpectrumWorkspaceReset();
+   source = SpectrumWorkspaceAlloc(ssizex);
+   if (source == NULL)
+      Rf_error( "Not enough memory for working space");
+   for (i = 0; i < ssizex; i++)
+      source[i] = REAL(R_source)[i];
+   message = SpectrumUnfolding(source, REAL(R_respMatrix), ssizex, ssizey,
+                               numberIterations, numberRepetitions, boost);
+   if (message != 0) {
+      SpectrumWorkspaceReset();
+      Rf_error( "%s", message);
+   }
+   PROTECT(f = allocVector(REALSXP, ssizey));
+   for (i = 0; i < ssizey; i++)
+      REAL(f)[i] = source[i];
+   SpectrumWorkspaceReset();
+   UNPROTECT(1);
+   return f;
+}
+
+typedef struct {
+   double position;               //centroid of the peak
+   double height;                 //height in the spectrum
+   int order;                     //number of the peak in channel order
+} SearchPeak;
+
+static int SearchPeakBelow(const SearchPeak *a, const SearchPeak *b)
+{
+//a is ranked below b: lower, or as high and found later
+   return a->height < b->height || (a->height == b->height && a->order > b->order);
+}
+
+static void SearchPeakDown(SearchPeak *heap, int count, int i)
+{
+//restores the heap (lowest peak at the root) below i
+   int j;
+   SearchPeak peak = heap[i];
+   while ((j = 2 * i + 1) < count) {
+      if (j + 1 < count && SearchPeakBelow(&heap[j + 1], &heap[j]))
+         j += 1;
+      if (!SearchPeakBelow(&heap[j], &peak))
+         break;
+      heap[i] = heap[j];
+      i = j;
+   }
+   heap[i] = peak;
+}
+
+static void SearchPeakPush(SearchPeak *heap, int *count, int maximum,
+                           const SearchPeak *peak)
+{
+/////////////////////////////////////////////////////////////////////////////
+//        Adds a peak to the heap of the maximum highest peaks found so
+//        far, so keeping k of p peaks costs O(p log k).
+/////////////////////////////////////////////////////////////////////////////
+   int i, j;
+   if (*count == maximum) {
+      if (SearchPeakBelow(&heap[0], peak)) {
+         heap[0] = *peak;
+         SearchPeakDown(heap, *count, 0);
+      }
+      return;
+   }
+   for (i = (*count)++; i > 0; i = j) {
+      j = (i - 1) / 2;
+      if (!SearchPeakBelow(peak, &heap[j]))
+         break;
+      heap[i] = heap[j];
+   }
+   heap[i] = *peak;
+}
+
+static double SearchPeakWidth(const double *y, int size, int i)
+{
+/////////////////////////////////////////////////////////////////////////////
+//        Sigma of the peak of y nearest to channel i from its full width
+//        at half maximum, the crossings of the half height interpolated
+//        linearly between channels. NAN if the peak is not positive or
+//        does not drop to half its height within y.
+/////////////////////////////////////////////////////////////////////////////
+   int l, r;
+   double half, left, right;
+//climb to the top of the peak
+   while (i > 0 && y[i - 1] > y[i])
+      i -= 1;
+   while (i < size - 1 && y[i + 1] > y[i])
+      i += 1;
+   if (!(y[i] > 0))
+      return NAN;
+   half = y[i] / 2;
+   for (l = i; l > 0 && y[l - 1] > half; l--)
+      ;
+   for (r = i; r < size - 1 && y[r + 1] > half; r++)
+      ;
+   if (l == 0 || r == size - 1)
+      return NAN;
+   left = l - (y[l] - half) / (y[l] - y[l - 1]);
+   right = r + (y[r] - half) / (y[r] - y[r + 1]);
+   return (right - left) / (2 * sqrt(2 * log(2.0)));
+}
+
+int SpectrumSearchExtended(int ssize, double sigma)
+{
+//length of the spectrum extended at both ends by the peak search
+   return ssize + 2 * (int) (7 * sigma + 0.5);
+}
+
+static double SearchResponse(double *response, int size_ext, double sigma,
+                             int *posit, int *lh_gold)
+{
+/////////////////////////////////////////////////////////////////////////////
+//        Response of the peak search, a Gaussian of sigma rounded to
+//        integers of maximum 1000, written to response unless it is NULL.
+//        Returns its area and sets the position of its maximum and its
+//        length without the zero tail.
+/////////////////////////////////////////////////////////////////////////////
+   int i, j;
+   double lda, area = 0, maximum = 0;
+   *lh_gold = -1;
+   *posit = 0;
+   for(i = 0; i < size_ext; i++){
+      lda = (double)i - 3 * sigma;
+      lda = lda * lda / (2 * sigma * sigma);
+      j = (int)(1000 * exp(-lda));
+      lda = j;
+      if(lda != 0)
+         *lh_gold = i + 1;
+
+      if (response != NULL)
+         response[i] = lda;
+      area = area + lda;
+      if(lda > maximum){
+         maximum = lda;
+         *posit = i;
+      }
+   }
+   return area;
+}
+
+static double SearchMagnitude(double x, int exact)
+{
+//magnitude of a channel in the tests of the peak search. The original
+//code took the integer abs(), truncating it; a search started from an
+//initial solution, whose channels are far below 1, needs the exact one
+   return exact ? fabs(x) : abs((int) x);
+}
+
+void SpectrumSearchInitial(const double *destVector, double *init, int ssize,
+                           double sigma)
+{
+/////////////////////////////////////////////////////////////////////////////
+//        Initial solution of the deconvolution of the peak search from a
+//        deconvolved spectrum destVector (ssize channels) it returned,
+//        inverting its shift and scaling by the response. The channels
+//        of the extension take the value of the nearest channel of the
+//        spectrum. init has SpectrumSearchExtended(ssize, sigma) channels.
+/////////////////////////////////////////////////////////////////////////////
+   int size_ext = SpectrumSearchExtended(ssize, sigma);
+   int shift = (size_ext - ssize) / 2, posit, lh_gold, i, j;
+   double area = SearchResponse(NULL, size_ext, sigma, &posit, &lh_gold);
+   for (i = 0; i < size_ext; i++) {
+      j = i + posit - (lh_gold - 1) - shift;
+      if (j < 0)
+         j = 0;
+      if (j > ssize - 1)
+         j = ssize - 1;
+      init[i] = area > 0 ? destVector[j] / area : 1;
+   }
+}
 
+const char *SpectrumSearchHighRes(const double *source, double *destVector,
+                                  int ssize, double sigma, double threshold,
+                                  int backgroundRemove, int deconIterations,
+                                  int markov, int averWindow,
+                                  int acceleration, const double *init,
+                                  double *solution, double *fPositionX,
+                                  SpectrumPeak *fPeaks, int fMaxPeaks,
+                                  int *fNPeaks)
+{
 /////////////////////////////////////////////////////////////////////////////
 //        ONE-DIMENSIONAL HIGH-RESOLUTION PEAK SEARCH FUNCTION
 //        This function searches for peaks in source spectrum
@@ -1332,44 +1723,68 @@ SEXP R_SpectrumSearchHighRes(SEXP R_source,
 //             chains method.
 //        averWindow-averanging window of searched peaks, for details
 //                  we refer to manual (applies only for Markov method)
+//      acceleration-kAccelerationNone or kAccelerationBiggsAndrews, the
+//                   extrapolation of the deconvolution iterations
+//        init-initial solution of the deconvolution, of
+//             SpectrumSearchExtended(ssize, sigma) channels as left in
+//             solution by a previous search or made from its destVector
+//             by SpectrumSearchInitial, or NULL to start from 1
+//        solution-where the solution of the deconvolution is left (before
+//                 it is shifted and scaled to destVector), or NULL; it may
+//                 be init
+//        fPositionX-pointer to the vector of positions of found peaks,
+//                   centroids of the deconvolved spectrum (0-based),
+//                   the highest peaks first
+//        fPeaks-pointer to the vector of their descriptors, or NULL:
+//               the centroid again, the heights of the spectrum without
+//               the background, of the source and of the deconvolved
+//               spectrum and the background in the channel of the
+//               centroid, and sigma estimated from the FWHM of the peak
+//               in the spectrum without the background
+//        fMaxPeaks-maximal number of peaks stored, the highest are kept
+//        fNPeaks-number of found peaks, -1 if the spectrum is empty
+//                (destVector is not set then)
+//
+//        The function does not call R, so it can run in any thread; it
+//        returns 0 or an error message.
 //
 /////////////////////////////////////////////////////////////////////////////
 //
    int i, j, numberIterations = (int)(7 * sigma + 0.5);
-   double a, b, c;
-   int k, lindex, posit, imin, imax, jmin, jmax, lh_gold, priz;
+   double a, b;
+   int k, lindex, posit, imin, imax, jmin, jmax, lh_gold, count = 0;
    double lda, ldb, ldc, area, maximum, maximum_decon;
-   int xmin, xmax, l, peak_index = 0, size_ext = ssize + 2 * numberIterations, shift = numberIterations, bw = 2, w;
+   int peak_index = 0, size_ext = ssize + 2 * numberIterations, shift = numberIterations, bw = 2;
    double maxch;
-   double nom, nip, nim, sp, sm, plocha = 0;
-   double m0low=0,m1low=0,m2low=0,l0low=0,l1low=0,detlow,av,men;
+   const char *message;
+   double m0low=0,m1low=0,m2low=0,l0low=0,l1low=0,detlow;
+   double *average = NULL, *prefix = NULL, *background = NULL;
+   SearchPeak *heap, peak;
+   SpectrumAcceleration accelerator, *acc = NULL;
+   if (fMaxPeaks <= 0)
+      return "Wrong Parameters";
    if (sigma < 1) {
-      Rf_error("SearchHighRes", "Invalid sigma, must be greater than or equal to 1");
-      return 0;
+      return "Invalid sigma, must be greater than or equal to 1";
    }
 
    if(threshold<=0 || threshold>=100){
-      Rf_error("SearchHighRes", "Invalid threshold, must be positive and less than 100");
-      return 0;
+      return "Invalid threshold, must be positive and less than 100";
    }
 
    j = (int) (5.0 * sigma + 0.5);
    if (j >= PEAK_WINDOW / 2) {
-      Rf_error("SearchHighRes", "Too large sigma");
-      return 0;
+      return "Too large sigma";
    }
 
    if (markov == TRUE) {
       if (averWindow <= 0) {
-         Rf_error("SearchHighRes", "Averanging window must be positive");
-         return 0;
+         return "Averanging window must be positive";
       }
    }
 
    if(backgroundRemove == TRUE){
       if(ssize < 2 * numberIterations + 1){
-         Rf_error("SearchHighRes", "Too large clipping window");
-         return 0;
+         return "Too large clipping window";
       }
    }
 
@@ -1393,10 +1808,30 @@ SEXP R_SpectrumSearchHighRes(SEXP R_source,
       l1low = 0;
    }
 
-   i = (int)(7 * sigma + 0.5);
-   i = 2 * i;
-   double working_space[7 * (ssize + i)];
-   for (j=0;j<7 * (ssize + i);j++) working_space[j] = 0;
+   size_t mark = SpectrumWorkspaceMark();
+   double *working_space = SpectrumWorkspaceAlloc(7 * (size_t) size_ext);
+   if (backgroundRemove == TRUE && markov == TRUE) {
+      average = SpectrumWorkspaceAlloc(size_ext);
+      prefix = SpectrumWorkspaceAlloc(size_ext);
+   }
+//the arena hands out doubles
+   heap = (SearchPeak *) SpectrumWorkspaceAlloc(((size_t) fMaxPeaks * sizeof(SearchPeak) + sizeof(double) - 1) / sizeof(double));
+//the background of the peaks, kept before it is subtracted
+   if (backgroundRemove == TRUE && fPeaks != NULL)
+      background = SpectrumWorkspaceAlloc(size_ext);
+   if (working_space == NULL || heap == NULL || (backgroundRemove == TRUE && markov == TRUE && (average == NULL || prefix == NULL)) || (backgroundRemove == TRUE && fPeaks != NULL && background == NULL)) {
+      SpectrumWorkspaceRelease(mark);
+      return "Not enough memory for working space";
+   }
+   if (acceleration == kAccelerationBiggsAndrews) {
+      acc = &accelerator;
+      if (SpectrumAccelerationInit(acc, size_ext) != 0) {
+         SpectrumWorkspaceRelease(mark);
+         return "Not enough memory for working space";
+      }
+   }
+//the deconvolution keeps its previous value where it is not updated
+   for (j = 0; j < size_ext; j++) working_space[3 * size_ext + j] = 0;
    for(i = 0; i < size_ext; i++){
       if(i < shift){
          a = i - shift;
@@ -1418,54 +1853,15 @@ SEXP R_SpectrumSearchHighRes(SEXP R_source,
 
    if(backgroundRemove == TRUE){
       for(i = 1; i <= numberIterations; i++){
-         for(j = i; j < size_ext - i; j++){
-            if(markov == FALSE){
-               a = working_space[size_ext + j];
-               b = (working_space[size_ext + j - i] + working_space[size_ext + j + i]) / 2.0;
-               if(b < a)
-                  a = b;
-
-               working_space[j]=a;
-            }
-
-            else{
-               a = working_space[size_ext + j];
-               av = 0;
-               men = 0;
-               for (w = j - bw; w <= j + bw; w++){
-                  if ( w >= 0 && w < size_ext){
-                     av += working_space[size_ext + w];
-                     men +=1;
-                  }
-               }
-               av = av / men;
-               b = 0;
-               men = 0;
-               for (w = j - i - bw; w <= j - i + bw; w++){
-                  if ( w >= 0 && w < size_ext){
-                     b += working_space[size_ext + w];
-                     men +=1;
-                  }
-               }
-               b = b / men;
-               c = 0;
-               men = 0;
-               for (w = j + i - bw; w <= j + i + bw; w++){
-                  if ( w >= 0 && w < size_ext){
-                     c += working_space[size_ext + w];
-                     men +=1;
-                  }
-               }
-               c = c / men;
-               b = (b + c) / 2;
-               if (b < a)
-                  av = b;
-               working_space[j]=av;
-            }
-         }
+         if(markov == TRUE)
+            SpectrumSNIPAverage(working_space + size_ext, average, prefix, size_ext, bw, 0);
+         SpectrumSNIPClip(working_space + size_ext, markov == TRUE ? average : NULL, working_space, size_ext, i, kBackOrder2);
          for(j = i; j < size_ext - i; j++)
             working_space[size_ext + j] = working_space[j];
       }
+      if (background != NULL)
+         for(j = 0; j < size_ext; j++)
+            background[j] = working_space[size_ext + j];
       for(j = 0;j < size_ext; j++){
          if(j < shift){
          	  a = j - shift;
@@ -1500,66 +1896,23 @@ SEXP R_SpectrumSearchHighRes(SEXP R_source,
    if(markov == TRUE){
       for(j = 0; j < size_ext; j++)
          working_space[2 * size_ext + j] = working_space[size_ext + j];
-      xmin = 0,xmax = size_ext - 1;
       for(i = 0, maxch = 0; i < size_ext; i++){
-         working_space[i] = 0;
          if(maxch < working_space[2 * size_ext + i])
             maxch = working_space[2 * size_ext + i];
-         plocha += working_space[2 * size_ext + i];
       }
       if(maxch == 0) {
+         *fNPeaks = -1;
+         SpectrumWorkspaceRelease(mark);
          return 0;
       }
 
-      nom = 1;
-      working_space[xmin] = 1;
-      for(i = xmin; i < xmax; i++){
-         nip = working_space[2 * size_ext + i] / maxch;
-         nim = working_space[2 * size_ext + i + 1] / maxch;
-         sp = 0,sm = 0;
-         for(l = 1; l <= averWindow; l++){
-            if((i + l) > xmax)
-               a = working_space[2 * size_ext + xmax] / maxch;
-
-            else
-               a = working_space[2 * size_ext + i + l] / maxch;
-
-            b = a - nip;
-            if(a + nip <= 0)
-               a=1;
-
-            else
-               a = sqrt(a + nip);
-
-            b = b / a;
-            b = exp(b);
-            sp = sp + b;
-            if((i - l + 1) < xmin)
-               a = working_space[2 * size_ext + xmin] / maxch;
-
-            else
-               a = working_space[2 * size_ext + i - l + 1] / maxch;
-
-            b = a - nim;
-            if(a + nim <= 0)
-               a = 1;
-
-            else
-               a = sqrt(a + nim);
-
-            b = b / a;
-            b = exp(b);
-            sm = sm + b;
-         }
-         a = sp / sm;
-         a = working_space[i + 1] = working_space[i] * a;
-         nom = nom + a;
+      message = SpectrumSmoothMarkov(working_space + 2 * size_ext,
+                                     working_space + size_ext, size_ext,
+                                     averWindow, kMarkovExact, 1);
+      if (message != 0) {
+         SpectrumWorkspaceRelease(mark);
+         return message;
       }
-      for(i = xmin; i <= xmax; i++){
-         working_space[i] = working_space[i] / nom;
-      }
-      for(j = 0; j < size_ext; j++)
-         working_space[size_ext + j] = working_space[j] * plocha;
       for(j = 0; j < size_ext; j++){
          working_space[2 * size_ext + j] = working_space[size_ext + j];
       }
@@ -1581,29 +1934,11 @@ SEXP R_SpectrumSearchHighRes(SEXP R_source,
       }
    }
 //deconvolution starts
-   area = 0;
-   lh_gold = -1;
-   posit = 0;
-   maximum = 0;
 //generate response vector
-   for(i = 0; i < size_ext; i++){
-      lda = (double)i - 3 * sigma;
-      lda = lda * lda / (2 * sigma * sigma);
-      j = (int)(1000 * exp(-lda));
-      lda = j;
-      if(lda != 0)
-         lh_gold = i + 1;
-
-      working_space[i] = lda;
-      area = area + lda;
-      if(lda > maximum){
-         maximum = lda;
-         posit = i;
-      }
-   }
+   area = SearchResponse(working_space, size_ext, sigma, &posit, &lh_gold);
 //read source vector
    for(i = 0; i < size_ext; i++)
-      working_space[2 * size_ext + i] = abs(working_space[size_ext + i]);
+      working_space[2 * size_ext + i] = SearchMagnitude(working_space[size_ext + i], init != NULL);
 //create matrix at*a(vector b)
    i = lh_gold - 1;
    if(i > size_ext)
@@ -1646,12 +1981,17 @@ SEXP R_SpectrumSearchHighRes(SEXP R_source,
    for(i = imin; i <= imax; i++)
       working_space[2 * size_ext + i - imin] = working_space[4 * size_ext + i - imin];
 //initialization of resulting vector
-   for(i = 0; i < size_ext; i++)
-      working_space[i] = 1;
+   for(i = 0; i < size_ext; i++){
+      working_space[i] = init != NULL ? init[i] : 1;
+      if (SearchMagnitude(working_space[i], init != NULL) <= 0.00001)
+         working_space[3 * size_ext + i] = working_space[i];
+   }
+   if (acc != NULL)
+      SpectrumAccelerationStart(acc, working_space);
 //START OF ITERATIONS
    for(lindex = 0; lindex < deconIterations; lindex++){
       for(i = 0; i < size_ext; i++){
-         if(abs(working_space[2 * size_ext + i]) > 0.00001 && abs(working_space[i]) > 0.00001){
+         if(SearchMagnitude(working_space[2 * size_ext + i], init != NULL) > 0.00001 && SearchMagnitude(working_space[i], init != NULL) > 0.00001){
             lda=0;
             jmin = lh_gold - 1;
             if(jmin > i)
@@ -1679,10 +2019,13 @@ SEXP R_SpectrumSearchHighRes(SEXP R_source,
             working_space[3 * size_ext + i] = lda;
          }
       }
-      for(i = 0; i < size_ext; i++){
-         working_space[i] = working_space[3 * size_ext + i];
-      }
+      SpectrumIterationNext(NULL, acc, 0, lindex,
+                            lindex == deconIterations - 1, working_space,
+                            working_space + 3 * size_ext, size_ext);
    }
+   if (solution != NULL)
+      for(i = 0; i < size_ext; i++)
+         solution[i] = working_space[i];
 //shift resulting spectrum
    for(i=0;i<size_ext;i++){
       lda = working_space[i];
@@ -1725,60 +2068,129 @@ SEXP R_SpectrumSearchHighRes(SEXP R_source,
 
                if(a >= ssize)
                   a = ssize - 1;
-               if(peak_index == 0){
-                  fPositionX[0] = a;
-                  peak_index = 1;
-               }
-
-               else{
-                  for(j = 0, priz = 0; j < peak_index && priz == 0; j++){
-                     if(working_space[6 * size_ext + shift + (int)a] > working_space[6 * size_ext + shift + (int)fPositionX[j]])
-                        priz = 1;
-                  }
-                  if(priz == 0){
-                     if(j < fMaxPeaks){
-                        fPositionX[j] = a;
-                     }
-                  }
-
-                  else{
-                     for(k = peak_index; k >= j; k--){
-                        if(k < fMaxPeaks){
-                           fPositionX[k] = fPositionX[k - 1];
-                        }
-                     }
-                     fPositionX[j - 1] = a;
-                  }
-                  if(peak_index < fMaxPeaks)
-                     peak_index += 1;
-               }
+               peak.position = a;
+               peak.height = working_space[6 * size_ext + shift + (int)a];
+               peak.order = peak_index++;
+               SearchPeakPush(heap, &count, fMaxPeaks, &peak);
             }
          }
       }
    }
 
-   fNPeaks = peak_index;
-   PROTECT(destVector = allocVector(REALSXP,ssize));
+//highest peaks first, the equal ones in the order of the channels
+   *fNPeaks = count;
+   while (count > 1) {
+      peak = heap[0];
+      heap[0] = heap[--count];
+      SearchPeakDown(heap, count, 0);
+      heap[count] = peak;
+   }
+   for (i = 0; i < *fNPeaks; i++) {
+      fPositionX[i] = heap[i].position;
+      if (fPeaks == NULL)
+         continue;
+      j = (int) heap[i].position;
+      fPeaks[i].position = heap[i].position;
+      fPeaks[i].height = heap[i].height;
+      fPeaks[i].raw = source[j];
+      fPeaks[i].deconvolved = working_space[shift + j];
+      fPeaks[i].background = background != NULL ? background[shift + j] : 0;
+      fPeaks[i].sigma = SearchPeakWidth(working_space + 6 * size_ext, size_ext, shift + j);
+   }
    for (i = 0; i < ssize; i++){
-      REAL(destVector)[i] = working_space[shift+i];
+      destVector[i] = working_space[shift+i];
    }
-   UNPROTECT(1);
-   PROTECT(f = allocVector(INTSXP,fNPeaks));
-   for (i = 0; i < fNPeaks; i++){
+   SpectrumWorkspaceRelease(mark);
+   return 0;
+}
+
+SEXP R_SpectrumSearchHighRes(SEXP R_source,
+                                     SEXP R_sigma, SEXP R_threshold,
+                                     SEXP  R_backgroundRemove, SEXP R_deconIterations,
+                                     SEXP  R_markov, SEXP  R_averWindow,
+                                     SEXP R_acceleration, SEXP R_maxPeaks,
+                                     SEXP R_init, SEXP R_output)
+{
+     const double *source, *previous;
+     int ssize;
+     double sigma=REAL(R_sigma)[0];
+     double threshold=REAL(R_threshold)[0];
+     int backgroundRemove=INTEGER(R_backgroundRemove)[0];
+     int deconIterations=INTEGER(R_deconIterations)[0];
+     int markov=INTEGER(R_markov)[0];
+     int averWindow=INTEGER(R_averWindow)[0];
+     int acceleration=INTEGER(R_acceleration)[0];
+     int fMaxPeaks=INTEGER(R_maxPeaks)[0];
+     int fNPeaks, i;
+     double *fPositionX, *init = NULL;
+     SpectrumPeak *fPeaks;
+     const char *message;
+     static const char *names[] = {"pos", "y", "position", "height", "raw",
+                                   "deconvolved", "background", "sigma"};
+     SEXP destVector,f,ans,ans_names;
+
+   SpectrumWorkspaceReset();
+   source = SpectrumInput(R_source, &ssize);
+//all peaks unless a maximum is given
+   if (fMaxPeaks == NA_INTEGER || fMaxPeaks > ssize)
+      fMaxPeaks = ssize;
+   if (fMaxPeaks <= 0)
+      Rf_error( "Wrong Parameters");
+   fPositionX = SpectrumWorkspaceAlloc(fMaxPeaks);
+//the arena hands out doubles
+   fPeaks = (SpectrumPeak *) SpectrumWorkspaceAlloc(((size_t) fMaxPeaks * sizeof(SpectrumPeak) + sizeof(double) - 1) / sizeof(double));
+   if (fPositionX == NULL || fPeaks == NULL)
+      Rf_error( "Not enough memory for working space");
+   if (R_init != R_NilValue) {
+      previous = SpectrumInput(R_init, &i);
+      if (i != ssize)
+         Rf_error( "Initial estimate must have the length of the spectrum");
+      if (sigma >= 1) {
+         init = SpectrumWorkspaceAlloc(SpectrumSearchExtended(ssize, sigma));
+         if (init == NULL)
+            Rf_error( "Not enough memory for working space");
+         SpectrumSearchInitial(previous, init, ssize, sigma);
+      }
+   }
+   PROTECT(destVector = SpectrumOutput(R_output, ssize, R_source, R_init));
+   message = SpectrumSearchHighRes(source, SpectrumOutputData(destVector), ssize, sigma,
+                                   threshold, backgroundRemove,
+                                   deconIterations, markov, averWindow,
+                                   acceleration, init, NULL, fPositionX,
+                                   fPeaks, fMaxPeaks, &fNPeaks);
+   if (message != 0) {
+      SpectrumWorkspaceReset();
+      Rf_error( "%s", message);
+   }
+   if (fNPeaks < 0) {
+      SpectrumWorkspaceReset();
+      UNPROTECT(1);
+      return R_NilValue;
+   }
+   PROTECT(ans = allocVector(VECSXP,8));
+   PROTECT(ans_names = allocVector(VECSXP,8));
+   for (i = 0; i < 8; i++)
+      SET_VECTOR_ELT(ans_names,i,Rf_mkString(names[i]));
+   SET_VECTOR_ELT(ans,1,destVector);
+   SET_VECTOR_ELT(ans,0,f = allocVector(INTSXP,fNPeaks));
+   for (i = 0; i < fNPeaks; i++)
      /*to account for 1-based vectros in R*/
       INTEGER(f)[i] = (int)fPositionX[i]+1;
+   for (i = 2; i < 8; i++)
+      SET_VECTOR_ELT(ans,i,allocVector(REALSXP,fNPeaks));
+   for (i = 0; i < fNPeaks; i++){
+      REAL(VECTOR_ELT(ans,2))[i] = fPeaks[i].position+1;
+      REAL(VECTOR_ELT(ans,3))[i] = fPeaks[i].height;
+      REAL(VECTOR_ELT(ans,4))[i] = fPeaks[i].raw;
+      REAL(VECTOR_ELT(ans,5))[i] = fPeaks[i].deconvolved;
+      REAL(VECTOR_ELT(ans,6))[i] = fPeaks[i].background;
+      REAL(VECTOR_ELT(ans,7))[i] = fPeaks[i].sigma;
    }
-   UNPROTECT(1);
-   PROTECT(ans = allocVector(VECSXP,2));
-   PROTECT(ans_names = allocVector(VECSXP,2));
-   SET_VECTOR_ELT(ans_names,1,Rf_mkString("y"));
-   SET_VECTOR_ELT(ans_names,0,Rf_mkString("pos"));
-   SET_VECTOR_ELT(ans,1,destVector);
-   SET_VECTOR_ELT(ans,0,f);
+   SpectrumWorkspaceReset();
    setAttrib(ans, R_NamesSymbol, ans_names);
-   UNPROTECT(2);
-   if(peak_index == fMaxPeaks)
-      Rf_warning("SearchHighRes", "Peak buffer full");
+   UNPROTECT(3);
+   if(fNPeaks == ssize)
+      Rf_warning( "Peak buffer full");
    return(ans);
 }
 
@@ -0,0 +1,446 @@
+//__________________________________________________________________________
+//   SHARED DECLARATIONS OF THE SPECTRA PROCESSING FUNCTIONS               //
+//                                                                         //
+//   Internal helpers used by more than one translation unit of the       //
+//   package. Nothing declared here is visible from R.                     //
+//____________________________________________________________________________
+
+#ifndef RPEAKS_SPECTRUM_H
+#define RPEAKS_SPECTRUM_H
+
+#include <stddef.h>
+
+#if defined(__STDC_VERSION__) && __STDC_VERSION__ >= 201112L
+#define SPECTRUM_THREAD_LOCAL _Thread_local
+#elif defined(__GNUC__)
+#define SPECTRUM_THREAD_LOCAL __thread
+#elif defined(_MSC_VER)
+#define SPECTRUM_THREAD_LOCAL __declspec(thread)
+#else
+#define SPECTRUM_THREAD_LOCAL
+#endif
+
+   enum {
+       kBackOrder2 =0,
+       kBackOrder4 =1,
+       kBackOrder6 =2,
+       kBackOrder8 =3,
+       kBackIncreasingWindow =0,
+       kBackDecreasingWindow =1,
+       kBackSmoothing3 =3,
+       kBackSmoothing5 =5,
+       kBackSmoothing7 =7,
+       kBackSmoothing9 =9,
+       kBackSmoothing11 =11,
+       kBackSmoothing13 =13,
+       kBackSmoothing15 =15,
+       kBackDoublePrecision =0,
+       kBackSinglePrecision =1
+   };
+
+/////////////////////////////////////////////////////////////////////////////
+//        WORKING SPACE ARENA (workspace.c)
+//
+//        Every thread owns one arena. Buffers are handed out in stack
+//        order, 64-byte aligned and NOT initialized. A request that does
+//        not fit in the arena is served from a temporary block; when the
+//        arena is released completely it is regrown once to the largest
+//        size seen, so subsequent calls run without any allocation.
+//
+//        SpectrumWorkspaceMark    - current position of the arena
+//        SpectrumWorkspaceAlloc   - n doubles, NULL when out of memory
+//        SpectrumWorkspaceRelease - return everything allocated after mark
+//        SpectrumWorkspaceReset   - release everything (.Call entry points)
+//        SpectrumWorkspaceFree    - give the memory of all threads back to
+//                                   the system (outside parallel regions)
+//        SpectrumThreads          - OpenMP threads for a number of threads
+//                                   requested from R (NA: all processors)
+//
+/////////////////////////////////////////////////////////////////////////////
+size_t SpectrumWorkspaceMark(void);
+double *SpectrumWorkspaceAlloc(size_t n);
+void SpectrumWorkspaceRelease(size_t mark);
+void SpectrumWorkspaceReset(void);
+void SpectrumWorkspaceFree(void);
+int SpectrumThreads(int threads);
+
+   enum {
+       kEngineAuto =0,
+       kEngineDirect =1,
+       kEngineFFT =2
+   };
+
+/////////////////////////////////////////////////////////////////////////////
+//        REAL FAST FOURIER TRANSFORM (fft.c)
+//
+//        SpectrumFFTSize      - power of two >= n used as transform length
+//        SpectrumFFTInit      - twiddle factors (from the arena), 0 or -1
+//        SpectrumFFTForward   - real vector -> packed half spectrum
+//        SpectrumFFTInverse   - packed half spectrum -> real vector
+//        SpectrumFFTMultiply  - product of two packed half spectra
+//        SpectrumFFTPreferred - nonzero if the FFT engine is expected to
+//                               be faster than the direct one
+//
+/////////////////////////////////////////////////////////////////////////////
+typedef struct {
+   int n;                         //length of the real transform
+   double *twiddle;               //exp(-2*pi*i*k/n), k < n/2, (re, im)
+} SpectrumFFT;
+
+int SpectrumFFTSize(int n);
+int SpectrumFFTInit(SpectrumFFT *fft, int n);
+void SpectrumFFTForward(const SpectrumFFT *fft, double *x);
+void SpectrumFFTInverse(const SpectrumFFT *fft, double *x);
+void SpectrumFFTMultiply(double *x, const double *y, int n, int conjugate);
+int SpectrumFFTPreferred(int ssize, int lh_gold);
+
+/////////////////////////////////////////////////////////////////////////////
+//        CONVERGENCE OF THE DECONVOLUTION ITERATIONS (deconvolution.c)
+//
+//        A repetition of the Gold and Richardson-Lucy iterations stops
+//        as soon as the relative change of the solution in an iteration
+//        drops below tol. iterations and change (NULL or one element
+//        per repetition) receive the number of iterations done and the
+//        relative change of the last one.
+//
+//        SpectrumConvergenceUpdate - records an iteration, nonzero when
+//                                    the repetition has converged
+//
+/////////////////////////////////////////////////////////////////////////////
+typedef struct {
+   double tol;                    //relative change to stop at, 0 = never
+   int *iterations;               //iterations done in every repetition
+   double *change;                //last relative change of every repetition
+} SpectrumConvergence;
+
+int SpectrumConvergenceUpdate(SpectrumConvergence *conv, int repet,
+                              int lindex, const double *previous,
+                              const double *current, int ssize);
+
+/////////////////////////////////////////////////////////////////////////////
+//        INITIAL SOLUTION OF THE DECONVOLUTION (deconvolution.c)
+//
+//        The Gold and Richardson-Lucy iterations start from 1 in every
+//        channel, or warm from a previous result: the result is shifted
+//        by the position of the maximum of the response (and for Gold
+//        multiplied by its area), SpectrumDeconvolutionStart undoes that.
+//        The updates are multiplicative, channels started at 0 are not
+//        updated.
+//
+/////////////////////////////////////////////////////////////////////////////
+void SpectrumDeconvolutionStart(double *point, const double *init, int ssize,
+                                int posit, double scale);
+
+/////////////////////////////////////////////////////////////////////////////
+//        ACCELERATION OF THE DECONVOLUTION ITERATIONS (deconvolution.c)
+//
+//        Biggs-Andrews vector extrapolation of the multiplicative Gold and
+//        Richardson-Lucy updates. Every iteration is applied to a point
+//        extrapolated along the last step of the solution, the length of
+//        the extrapolation being estimated from the correlation of the
+//        last two corrections. Extrapolated channels which would become
+//        negative keep the unaccelerated value. The buffers come from the
+//        arena; the extrapolation restarts with every repetition.
+//
+//        SpectrumAccelerationInit  - buffers for ssize channels, 0 or -1
+//        SpectrumAccelerationStart - start of a repetition at point
+//        SpectrumIterationNext     - point of the next iteration from the
+//                                    result of the current one, records
+//                                    it in conv (both may be NULL) and
+//                                    returns nonzero when converged;
+//                                    result is left equal to point
+//
+//        D.S.C. Biggs, M. Andrews: Acceleration of iterative image
+//        restoration algorithms. Applied Optics 36 (1997) 1766-1775.
+//
+/////////////////////////////////////////////////////////////////////////////
+   enum {
+       kAccelerationNone =0,
+       kAccelerationBiggsAndrews =1
+   };
+
+typedef struct {
+   int ssize;                     //length of the solution
+   int count;                     //iterations done in the repetition
+   double *previous;              //last unaccelerated solution
+   double *step;                  //last correction, result - point
+} SpectrumAcceleration;
+
+int SpectrumAccelerationInit(SpectrumAcceleration *acc, int ssize);
+void SpectrumAccelerationStart(SpectrumAcceleration *acc,
+                               const double *point);
+int SpectrumIterationNext(SpectrumConvergence *conv,
+                          SpectrumAcceleration *acc, int repet, int lindex,
+                          int last, double *point, double *result,
+                          int ssize);
+
+/////////////////////////////////////////////////////////////////////////////
+//        PREPARED RESPONSE OF THE GOLD DECONVOLUTION (spectrum.c)
+//
+//        Everything the Gold deconvolution derives from the response
+//        alone, so that many spectra can be deconvolved with the same
+//        response without repeating it. All vectors are in one block
+//        obtained from malloc (not from the arena), which is owned by
+//        the structure and given back by SpectrumResponseFree.
+//
+//        SpectrumResponsePrepare - fills the structure, 0 or an error
+//        SpectrumResponseFree    - releases the vectors
+//
+/////////////////////////////////////////////////////////////////////////////
+typedef struct {
+   int ssize;                     //length of the spectra
+   int lh_gold;                   //length of the response without zero tail
+   int posit;                     //position of the maximum of the response
+   double area;                   //sum of the response
+   int engine;                    //kEngineDirect or kEngineFFT
+   double *response;              //response, lh_gold elements
+   double *ata;                   //vector at*a, lh_gold elements
+   int n;                         //transform length (kEngineFFT only)
+   double *spectrum;              //spectrum of the response, packed
+   double *kernel;                //spectrum of the symmetric at*a, packed
+   void *block;                   //memory of all vectors
+} SpectrumResponse;
+
+const char *SpectrumResponsePrepare(SpectrumResponse *prepared,
+                                    const double *response, int ssize,
+                                    int engine);
+void SpectrumResponseFree(SpectrumResponse *prepared);
+
+/////////////////////////////////////////////////////////////////////////////
+//        FFT ENGINES OF THE DECONVOLUTION FUNCTIONS (deconvolution.c)
+//
+//        Same iterations as the direct engines in spectrum.c with the
+//        convolutions evaluated by the FFT and the same acceleration
+//        (acc may be NULL). working_space has the layout
+//        of the direct engine (Gold 4*ssize, RL 5*ssize doubles); its
+//        first ssize elements hold the initial solution on input and the
+//        unshifted solution on return.
+//        SpectrumResponseFFT computes the vectors of a prepared response
+//        used by the Gold FFT engine. The return value is 0 or an error
+//        message.
+//
+/////////////////////////////////////////////////////////////////////////////
+const char *SpectrumResponseFFT(SpectrumResponse *prepared);
+const char *SpectrumDeconvolutionGoldFFT(double *working_space,
+                                         const double *source,
+                                         const SpectrumResponse *prepared,
+                                         int numberIterations,
+                                         int numberRepetitions, double boost,
+                                         SpectrumConvergence *conv,
+                                         SpectrumAcceleration *acc);
+const char *SpectrumDeconvolutionRLFFT(double *working_space, int ssize,
+                                       int lh_gold, int numberIterations,
+                                       int numberRepetitions, double boost,
+                                       SpectrumConvergence *conv,
+                                       SpectrumAcceleration *acc);
+
+/////////////////////////////////////////////////////////////////////////////
+//        ALGORITHMS OF THE .Call ENTRY POINTS (spectrum.c)
+//
+//        Versions of the entry points which do not call R and take their
+//        working space from the arena of the calling thread, so they can
+//        be run in parallel. The return value is 0 or an error message.
+//
+//        SpectrumSearchHighRes describes every peak it finds by a
+//        SpectrumPeak: its channel and heights are read from the
+//        vectors of the search, its width from the spectrum after
+//        background removal (and before Markov smoothing) at half the
+//        height of the peak.
+//
+/////////////////////////////////////////////////////////////////////////////
+typedef struct {
+   double position;               //centroid in the deconvolved spectrum
+   double height;                 //spectrum without background at it
+   double raw;                    //source spectrum at it
+   double deconvolved;            //deconvolved spectrum at it
+   double background;             //background at it, 0 if not removed
+   double sigma;                  //FWHM/2.3548, NAN if not measurable
+} SpectrumPeak;
+
+const char *SpectrumBackground(const double *spectrum, double *background,
+                               int ssize, int numberIterations,
+                               int direction, int filterOrder,
+                               int smoothing, int smoothWindow, int compton);
+const char *SpectrumBackgroundSingle(const float *spectrum,
+                                     double *background, int ssize,
+                                     int numberIterations, int direction,
+                                     int filterOrder, int smoothing,
+                                     int smoothWindow, int compton);
+void SpectrumBackgroundReach(int numberIterations, int smoothing,
+                             int smoothWindow, ptrdiff_t *left,
+                             ptrdiff_t *right);
+const char *SpectrumBackgroundPart(const double *spectrum, double *background,
+                                   int ssize, ptrdiff_t origin,
+                                   int numberIterations, int direction,
+                                   int filterOrder, int smoothing,
+                                   int smoothWindow);
+const char *SpectrumSearchHighRes(const double *source, double *destVector,
+                                  int ssize, double sigma, double threshold,
+                                  int backgroundRemove, int deconIterations,
+                                  int markov, int averWindow,
+                                  int acceleration, const double *init,
+                                  double *solution, double *fPositionX,
+                                  SpectrumPeak *fPeaks, int fMaxPeaks,
+                                  int *fNPeaks);
+int SpectrumSearchExtended(int ssize, double sigma);
+void SpectrumSearchInitial(const double *destVector, double *init, int ssize,
+                           double sigma);
+const char *SpectrumDeconvolutionGold(double *destination,
+                                      const double *source,
+                                      const SpectrumResponse *prepared,
+                                      int numberIterations,
+                                      int numberRepetitions, double boost,
+                                      int acceleration, const double *init,
+                                      SpectrumConvergence *conv);
+const char *SpectrumDeconvolutionRL(double *destination, const double *source,
+                                    const double *response, int ssize,
+                                    int engine, int numberIterations,
+                                    int numberRepetitions, double boost,
+                                    int acceleration, const double *init,
+                                    SpectrumConvergence *conv);
+const char *SpectrumUnfolding(double *source, const double *respMatrix,
+                              int ssizex, int ssizey, int numberIterations,
+                              int numberRepetitions, double boost);
+const char *SpectrumSmoothMarkov(const double *source, double *dest,
+                                 int ssize, int averWindow, int precision,
+                                 int threads);
+
+/////////////////////////////////////////////////////////////////////////////
+//        SNIP BACKGROUND CLIPPING KERNELS (snip.c)
+//
+//        SpectrumInstructionSet - vector instructions used by the kernels
+//        SpectrumSNIPClip       - one clipping pass of window i
+//        SpectrumSNIPAverage    - box averages for the smoothed filters
+//        SpectrumSNIPClipSingle, SpectrumSNIPAverageSingle
+//                               - the same in single precision
+//
+//        The prefix sums of the box averages restart every SNIP_BLOCK
+//        channels of the spectrum, which bounds their rounding error and
+//        makes the averages depend only on the absolute channel numbers.
+//
+/////////////////////////////////////////////////////////////////////////////
+#define SNIP_BLOCK 512
+
+   enum {
+       kInstructionScalar =0,
+       kInstructionSSE2 =1,
+       kInstructionAVX2 =2
+   };
+
+int SpectrumInstructionSet(void);
+void SpectrumSNIPClip(const double *source, const double *average,
+                      double *dest, int ssize, int i, int filterOrder);
+void SpectrumSNIPAverage(const double *source, double *average,
+                         double *prefix, int ssize, int bw,
+                         ptrdiff_t origin);
+void SpectrumSNIPClipSingle(const float *source, const float *average,
+                            float *dest, int ssize, int i, int filterOrder);
+void SpectrumSNIPAverageSingle(const float *source, float *average,
+                               double *prefix, int ssize, int bw,
+                               ptrdiff_t origin);
+
+/////////////////////////////////////////////////////////////////////////////
+//        TRANSITION TERMS OF THE MARKOV CHAIN SMOOTHING (markov.c)
+//
+//        SpectrumMarkovPairs - exp((s[j+d]-s[j]) / sqrt(s[j+d]+s[j])) and
+//                              its reciprocal for the distances d of the
+//                              averaging window
+//
+/////////////////////////////////////////////////////////////////////////////
+   enum {
+       kMarkovExact =0,
+       kMarkovFast =1
+   };
+
+void SpectrumMarkovPairs(const double *s, int j, int count, double *e,
+                         double *reciprocal, int precision);
+
+/////////////////////////////////////////////////////////////////////////////
+//        LEAST SQUARES FITTING OF PEAKS (fit.c)
+//
+//        SpectrumCholesky      - Cholesky factor of a symmetric matrix in
+//                                place, within its profile if it is
+//                                given; nonzero if it is not positive
+//                                definite
+//        SpectrumCholeskySolve - solution of the system of the factor
+//        SpectrumFitGaussian   - Levenberg-Marquardt fit of a Gaussian
+//                                (mu, sigma, scale) to the points of a
+//                                peak, 0 or an error message
+//        SpectrumPeakWindow    - channels of a peak down to a fraction
+//                                of its height and its interpolated
+//                                half height crossings
+//        SpectrumPeakStart     - start values of the fit of a peak
+//                                estimated in its window
+//        SpectrumFitPeak       - Gaussian fit of the window of a peak
+//                                from those start values
+//        SpectrumFitMultiplet  - joint fit of overlapping Gaussians and a
+//                                polynomial background
+//
+/////////////////////////////////////////////////////////////////////////////
+typedef struct {
+   int lower, upper;              //channels down to the cutoff
+   int lowerHalf, upperHalf;      //outermost ones at half height
+   double left, right;            //x at half height, interpolated, NAN
+   double leftCutoff, rightCutoff; //and at the cutoff outside x
+   int truncated;                 //window ends at an end of y
+} SpectrumWindow;
+
+int SpectrumCholesky(double *a, int p, const int *first);
+void SpectrumCholeskySolve(const double *l, int p, const int *first,
+                           double *b);
+const char *SpectrumFitGaussian(const double *x, const double *y, int n,
+                                double *par, double *se, double *rss,
+                                int *iterations, int maxIterations,
+                                double tol);
+void SpectrumPeakWindow(const double *x, const double *y, int n, int i,
+                        double cutoff, SpectrumWindow *window);
+void SpectrumPeakStart(const double *x, const double *y, int n, int i,
+                       double cutoff, double *start, int *lower, int *upper);
+const char *SpectrumFitPeak(const double *x, const double *y, int n, int i,
+                            double cutoff, double *start, double *par,
+                            double *se, int *lower, int *upper,
+                            int *iterations, int maxIterations, double tol);
+const char *SpectrumFitMultiplet(const double *x, const double *y, int n,
+                                 int npeaks, int order, double *par,
+                                 double *se, double *rss, int *iterations,
+                                 int maxIterations, double tol);
+
+/////////////////////////////////////////////////////////////////////////////
+//        MOMENTS OF PEAK REGIONS (moments.c)
+//
+//        SpectrumMoments - weight, weighted mean and weighted sum of
+//                          squares about a mean of the points of a
+//                          segment, compensated and vectorized
+//
+/////////////////////////////////////////////////////////////////////////////
+void SpectrumMoments(const double *x, const double *y, int n,
+                     int logarithm, const double *mu, double *moments);
+
+/////////////////////////////////////////////////////////////////////////////
+//        SPECTRA OF THE .Call ENTRY POINTS (input.c)
+//
+//        SpectrumInput      - channels of an R numeric or integer vector
+//                             or of a mapped spectrum file, as doubles
+//        SpectrumInputSingle - the same in single precision
+//        SpectrumOutput     - new numeric vector, or new mapped float64
+//                             file named by R_output (not the file of
+//                             a spectrum it is computed from), for a
+//                             result
+//        SpectrumOutputData - channels of a result of SpectrumOutput
+//
+/////////////////////////////////////////////////////////////////////////////
+   enum {
+       kInputFloat64 =0,
+       kInputFloat32 =1,
+       kInputUInt32 =2
+   };
+
+#ifdef R_INTERNALS_H_
+const double *SpectrumInput(SEXP R_y, int *ssize);
+const float *SpectrumInputSingle(SEXP R_y, int *ssize);
+SEXP SpectrumOutput(SEXP R_output, int ssize, SEXP R_source,
+                    SEXP R_init);
+double *SpectrumOutputData(SEXP f);
+#endif
+
+#endif
@@ -0,0 +1,614 @@
+//__________________________________________________________________________
+//   TRACKERS OF A SPECTRUM DURING ACQUISITION                             //
+//                                                                         //
+//   A background tracker keeps a copy of the spectrum and its SNIP       //
+//   background. When some channels change only the background within    //
+//   the reach of the clipping (SpectrumBackgroundReach) of them can       //
+//   change; it is recomputed by SpectrumBackgroundPart from the          //
+//   channels within the reach of that region, so an update costs time    //
+//   proportional to the number of changed channels (times the reach),    //
+//   not to the length of the spectrum, and leaves exactly the background //
+//   SpectrumBackground would give for the whole new spectrum. A peak     //
+//   search tracker searches the spectrum again after every update, its   //
+//   deconvolution started from the previous solution. The trackers are  //
+//   handed to R as external pointers with the tags and classes           //
+//   "rPeaksBackgroundTracker" and "rPeaksSearchTracker"; their memory is //
+//   released by the finalizers when R collects the objects.              //
+//____________________________________________________________________________
+
+#include <stdlib.h>
+
+#include <R.h>
+#include <Rinternals.h>
+
+#include "spectrum.h"
+
+typedef struct {
+   int ssize;
+   int numberIterations, direction, filterOrder, smoothing, smoothWindow;
+   ptrdiff_t left, right;         //reach of the clipping
+   double *spectrum;              //current spectrum
+   double *background;            //its background
+} BackgroundTracker;
+
+static void TrackerFree(BackgroundTracker *tracker)
+{
+   free(tracker->spectrum);
+   free(tracker->background);
+   free(tracker);
+}
+
+static void TrackerFinalizer(SEXP ptr)
+{
+   BackgroundTracker *tracker = (BackgroundTracker *) R_ExternalPtrAddr(ptr);
+   if (tracker == NULL)
+      return;
+   TrackerFree(tracker);
+   R_ClearExternalPtr(ptr);
+}
+
+static void *TrackerGet(SEXP R_tracker, const char *tag)
+{
+//tracker of an external pointer with the tag (and class) tag
+   void *tracker;
+   if (TYPEOF(R_tracker) != EXTPTRSXP
+       || R_ExternalPtrTag(R_tracker) != install(tag))
+      Rf_error( "Not a %s", tag);
+   tracker = R_ExternalPtrAddr(R_tracker);
+   if (tracker == NULL)
+      Rf_error( "Tracker is no longer valid");
+   return tracker;
+}
+
+static int CompareChannels(const void *a, const void *b)
+{
+   int x = *(const int *) a, y = *(const int *) b;
+   return (x > y) - (x < y);
+}
+
+static int *TrackerApply(double *spectrum, int ssize, SEXP R_channels,
+                         SEXP R_values, int add, double **saved)
+{
+/////////////////////////////////////////////////////////////////////////////
+//        Sets (or adds to, when add is TRUE) the channels R_channels
+//        (1-based, repeated channels applied in turn) of spectrum to
+//        R_values. Returns the changed channels, 0-based and sorted, and
+//        in saved the previous contents of the channels, for
+//        TrackerRestore. Every allocation is made before the spectrum is
+//        changed.
+/////////////////////////////////////////////////////////////////////////////
+   int count = LENGTH(R_channels);
+   int *sorted, i, j;
+   if (LENGTH(R_values) != count)
+      Rf_error( "Wrong Parameters");
+   sorted = (int *) R_alloc(count > 0 ? count : 1, sizeof(int));
+   *saved = (double *) R_alloc(count > 0 ? count : 1, sizeof(double));
+   for (i = 0; i < count; i++) {
+      j = INTEGER(R_channels)[i];
+      if (j == NA_INTEGER || j < 1 || j > ssize)
+         Rf_error( "Channel %d out of the spectrum", j);
+      sorted[i] = j - 1;
+   }
+   for (i = 0; i < count; i++) {
+      (*saved)[i] = spectrum[sorted[i]];
+      if (add == TRUE)
+         spectrum[sorted[i]] += REAL(R_values)[i];
+      else
+         spectrum[sorted[i]] = REAL(R_values)[i];
+   }
+   qsort(sorted, count, sizeof(int), CompareChannels);
+   return sorted;
+}
+
+static void TrackerRestore(double *spectrum, SEXP R_channels,
+                           const double *saved)
+{
+//undoes TrackerApply, the channels in the reverse order
+   int i;
+   for (i = LENGTH(R_channels) - 1; i >= 0; i--)
+      spectrum[INTEGER(R_channels)[i] - 1] = saved[i];
+}
+
+static const char *TrackerRegion(BackgroundTracker *tracker, int from,
+                                 int to)
+{
+/////////////////////////////////////////////////////////////////////////////
+//        Recomputes the background of the channels from..to (0-based),
+//        which must include every channel within the reach of the
+//        changed channels, from the channels within the reach of them.
+/////////////////////////////////////////////////////////////////////////////
+   ptrdiff_t lo, hi;
+   size_t mark;
+   double *part;
+   const char *message;
+   int j;
+   lo = from - tracker->left;
+   if (lo < 0)
+      lo = 0;
+//SpectrumBackgroundPart needs an origin on a block of the box averages
+   lo = lo / SNIP_BLOCK * SNIP_BLOCK;
+   hi = to + tracker->right;
+   if (hi > tracker->ssize - 1)
+      hi = tracker->ssize - 1;
+   mark = SpectrumWorkspaceMark();
+   part = SpectrumWorkspaceAlloc(hi - lo + 1);
+   if (part == NULL)
+      return "Not enough memory for working space";
+   message = SpectrumBackgroundPart(tracker->spectrum + lo, part,
+                                    (int) (hi - lo + 1), lo,
+                                    tracker->numberIterations,
+                                    tracker->direction, tracker->filterOrder,
+                                    tracker->smoothing,
+                                    tracker->smoothWindow);
+   if (message == 0)
+      for (j = from; j <= to; j++)
+         tracker->background[j] = part[j - lo];
+   SpectrumWorkspaceRelease(mark);
+   return message;
+}
+
+SEXP R_SpectrumBackgroundTracker(SEXP R_spectrum,
+                                 SEXP R_numberIterations,
+                                 SEXP R_direction, SEXP R_filterOrder,
+                                 SEXP R_smoothing, SEXP R_smoothWindow)
+{
+/////////////////////////////////////////////////////////////////////////////
+//        NEW BACKGROUND TRACKER
+//
+//        R_spectrum-initial spectrum (numeric or integer vector or mapped
+//                   file)
+//        the other parameters are those of R_SpectrumBackground
+//
+//        Returns an external pointer to the tracker holding the spectrum
+//        and its background.
+//
+/////////////////////////////////////////////////////////////////////////////
+   BackgroundTracker *tracker;
+   const double *spectrum;
+   const char *message;
+   int ssize, i;
+   SEXP ptr, cls;
+
+   SpectrumWorkspaceReset();
+   spectrum = SpectrumInput(R_spectrum, &ssize);
+//the object is made first, so no allocation by R can lose the tracker
+   PROTECT(ptr = R_MakeExternalPtr(NULL, install("rPeaksBackgroundTracker"), R_NilValue));
+   R_RegisterCFinalizerEx(ptr, TrackerFinalizer, TRUE);
+   PROTECT(cls = mkString("rPeaksBackgroundTracker"));
+   setAttrib(ptr, R_ClassSymbol, cls);
+   tracker = (BackgroundTracker *) calloc(1, sizeof(BackgroundTracker));
+   if (tracker == NULL)
+      Rf_error( "Not enough memory for background tracker");
+   R_SetExternalPtrAddr(ptr, tracker);
+   tracker->ssize = ssize;
+   tracker->numberIterations = INTEGER(R_numberIterations)[0];
+   tracker->direction = INTEGER(R_direction)[0];
+   tracker->filterOrder = INTEGER(R_filterOrder)[0];
+   tracker->smoothing = INTEGER(R_smoothing)[0];
+   tracker->smoothWindow = INTEGER(R_smoothWindow)[0];
+   SpectrumBackgroundReach(tracker->numberIterations, tracker->smoothing,
+                           tracker->smoothWindow, &tracker->left,
+                           &tracker->right);
+   if (ssize > 0) {
+      tracker->spectrum = (double *) malloc((size_t) ssize * sizeof(double));
+      tracker->background = (double *) malloc((size_t) ssize * sizeof(double));
+   }
+   if (ssize > 0 && (tracker->spectrum == NULL || tracker->background == NULL))
+      Rf_error( "Not enough memory for background tracker");
+   for (i = 0; i < ssize; i++)
+      tracker->spectrum[i] = spectrum[i];
+   message = SpectrumBackground(tracker->spectrum, tracker->background, ssize,
+                                tracker->numberIterations,
+                                tracker->direction, tracker->filterOrder,
+                                tracker->smoothing, tracker->smoothWindow,
+                                FALSE);
+   SpectrumWorkspaceReset();
+   if (message != 0)
+      Rf_error( "%s", message);
+   UNPROTECT(2);
+   return ptr;
+}
+
+SEXP R_SpectrumBackgroundUpdate(SEXP R_tracker, SEXP R_channels,
+                                SEXP R_values, SEXP R_add)
+{
+/////////////////////////////////////////////////////////////////////////////
+//        UPDATE OF A BACKGROUND TRACKER
+//
+//        R_tracker-tracker made by R_SpectrumBackgroundTracker
+//        R_channels-changed channels (1-based, in any order, repeated
+//                   channels are applied in turn)
+//        R_values-their new contents, or the counts added to them when
+//                 R_add is TRUE
+//
+//        Returns a list of the channels whose background was recomputed
+//        (channel, 1-based) and their new background (background). The
+//        channels changed in groups closer than the reach are recomputed
+//        together, and the whole background at once when the groups and
+//        their reach cover the spectrum. The tracker is left unchanged if
+//        the update fails.
+//
+/////////////////////////////////////////////////////////////////////////////
+   BackgroundTracker *tracker = TrackerGet(R_tracker, "rPeaksBackgroundTracker");
+   int count = LENGTH(R_channels);
+   int *sorted, *first, *last, i, j, k, n, regions;
+   ptrdiff_t lo, hi, work;
+   double *saved, *kept;
+   const char *message = 0;
+   SEXP ans, ans_names, channel, background;
+
+   first = (int *) R_alloc(count > 0 ? count : 1, sizeof(int));
+   last = (int *) R_alloc(count > 0 ? count : 1, sizeof(int));
+   sorted = TrackerApply(tracker->spectrum, tracker->ssize, R_channels,
+                         R_values, INTEGER(R_add)[0], &saved);
+
+//the background of channel j depends on the channels j-left..j+right,
+//so a change in channel c reaches the background of c-right..c+left;
+//changes closer than left+right make one region
+   for (i = 0, regions = 0, n = 0, work = 0; i < count; i = j) {
+      for (j = i + 1; j < count && sorted[j] - sorted[j - 1] <= tracker->left + tracker->right; j++)
+         ;
+      lo = sorted[i] - tracker->right;
+      hi = sorted[j - 1] + tracker->left;
+      if (lo < 0)
+         lo = 0;
+      if (hi > tracker->ssize - 1)
+         hi = tracker->ssize - 1;
+      first[regions] = (int) lo;
+      last[regions] = (int) hi;
+      n += last[regions] - first[regions] + 1;
+      regions += 1;
+//channels read by TrackerRegion for it
+      work += hi - lo + 1 + tracker->left + tracker->right;
+   }
+
+//the background of the regions is kept until every region succeeded, so
+//a failed update leaves the tracker as it was
+   kept = (double *) R_alloc(n > 0 ? n : 1, sizeof(double));
+   for (k = 0, i = 0; k < regions; k++)
+      for (j = first[k]; j <= last[k]; j++)
+         kept[i++] = tracker->background[j];
+   SpectrumWorkspaceReset();
+//regions (and their halos) covering the spectrum are recomputed at once
+   if (regions > 0 && work >= tracker->ssize)
+      message = TrackerRegion(tracker, 0, tracker->ssize - 1);
+
+   else
+      for (k = 0; k < regions && message == 0; k++)
+         message = TrackerRegion(tracker, first[k], last[k]);
+   SpectrumWorkspaceReset();
+   if (message != 0) {
+      TrackerRestore(tracker->spectrum, R_channels, saved);
+      for (k = 0, i = 0; k < regions; k++)
+         for (j = first[k]; j <= last[k]; j++)
+            tracker->background[j] = kept[i++];
+      Rf_error( "%s", message);
+   }
+   PROTECT(channel = allocVector(INTSXP, n));
+   PROTECT(background = allocVector(REALSXP, n));
+   for (k = 0, n = 0; k < regions; k++)
+      for (j = first[k]; j <= last[k]; j++, n++) {
+         INTEGER(channel)[n] = j + 1;
+         REAL(background)[n] = tracker->background[j];
+      }
+   PROTECT(ans = allocVector(VECSXP, 2));
+   PROTECT(ans_names = allocVector(STRSXP, 2));
+   SET_STRING_ELT(ans_names, 0, mkChar("channel"));
+   SET_STRING_ELT(ans_names, 1, mkChar("background"));
+   SET_VECTOR_ELT(ans, 0, channel);
+   SET_VECTOR_ELT(ans, 1, background);
+   setAttrib(ans, R_NamesSymbol, ans_names);
+   UNPROTECT(4);
+   return ans;
+}
+
+SEXP R_SpectrumBackgroundCurrent(SEXP R_tracker)
+{
+/////////////////////////////////////////////////////////////////////////////
+//        Current spectrum and background of a tracker, as a list
+/////////////////////////////////////////////////////////////////////////////
+   BackgroundTracker *tracker = TrackerGet(R_tracker, "rPeaksBackgroundTracker");
+   int i;
+   SEXP ans, ans_names, spectrum, background;
+   PROTECT(spectrum = allocVector(REALSXP, tracker->ssize));
+   PROTECT(background = allocVector(REALSXP, tracker->ssize));
+   for (i = 0; i < tracker->ssize; i++) {
+      REAL(spectrum)[i] = tracker->spectrum[i];
+      REAL(background)[i] = tracker->background[i];
+   }
+   PROTECT(ans = allocVector(VECSXP, 2));
+   PROTECT(ans_names = allocVector(STRSXP, 2));
+   SET_STRING_ELT(ans_names, 0, mkChar("spectrum"));
+   SET_STRING_ELT(ans_names, 1, mkChar("background"));
+   SET_VECTOR_ELT(ans, 0, spectrum);
+   SET_VECTOR_ELT(ans, 1, background);
+   setAttrib(ans, R_NamesSymbol, ans_names);
+   UNPROTECT(4);
+   return ans;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+//        PEAK SEARCH TRACKER
+//
+//        A search tracker keeps a copy of the spectrum, the solution of
+//        the Gold deconvolution of its last peak search and the peaks
+//        found. A search after an update starts the deconvolution from
+//        the previous solution instead of 1, so a few iterations
+//        (refreshIterations) bring it to the new spectrum, and reports
+//        the peaks which appeared, disappeared or moved since the
+//        previous search.
+//
+/////////////////////////////////////////////////////////////////////////////
+
+//channels of the initial solution are kept at least this fraction of
+//its maximum, so the multiplicative iterations can raise new peaks
+#define SEARCH_FLOOR 1e-3
+
+typedef struct {
+   int ssize, size_ext;
+   double sigma, threshold;
+   int backgroundRemove, deconIterations, refreshIterations;
+   int markov, averWindow, acceleration;
+   int tolerance;                 //largest move of a peak, in channels
+   double *spectrum;              //current spectrum
+   double *solution;              //solution of the last deconvolution
+   double *init;                  //initial solution of the next one
+   double *deconvolved;           //deconvolved spectrum of the last search
+   double *position;              //peaks of the last search, by height
+   int *sorted;                   //the same, 0-based channels in order
+   int peaks;                     //number of peaks, -1 if the spectrum
+                                  //was empty
+} SearchTracker;
+
+static void SearchTrackerFree(SearchTracker *tracker)
+{
+   free(tracker->spectrum);
+   free(tracker->solution);
+   free(tracker->init);
+   free(tracker->deconvolved);
+   free(tracker->position);
+   free(tracker->sorted);
+   free(tracker);
+}
+
+static void SearchTrackerFinalizer(SEXP ptr)
+{
+   SearchTracker *tracker = (SearchTracker *) R_ExternalPtrAddr(ptr);
+   if (tracker == NULL)
+      return;
+   SearchTrackerFree(tracker);
+   R_ClearExternalPtr(ptr);
+}
+
+static const char *SearchTrackerRun(SearchTracker *tracker, int iterations)
+{
+/////////////////////////////////////////////////////////////////////////////
+//        Searches the current spectrum, the deconvolution started from
+//        the previous solution if there is one.
+/////////////////////////////////////////////////////////////////////////////
+   const double *init = NULL;
+   const char *message;
+   double floor = 0;
+   int i;
+   if (tracker->peaks >= 0) {
+      for (i = 0; i < tracker->size_ext; i++)
+         if (floor < tracker->solution[i])
+            floor = tracker->solution[i];
+      floor *= SEARCH_FLOOR;
+      for (i = 0; i < tracker->size_ext; i++)
+         tracker->init[i] = tracker->solution[i] > floor ? tracker->solution[i] : floor;
+      if (floor > 0)
+         init = tracker->init;
+   }
+   SpectrumWorkspaceReset();
+   message = SpectrumSearchHighRes(tracker->spectrum, tracker->deconvolved,
+                                   tracker->ssize, tracker->sigma,
+                                   tracker->threshold,
+                                   tracker->backgroundRemove, iterations,
+                                   tracker->markov, tracker->averWindow,
+                                   tracker->acceleration, init,
+                                   tracker->solution, tracker->position,
+                                   NULL, tracker->ssize, &tracker->peaks);
+   SpectrumWorkspaceReset();
+   if (message != 0)
+      return message;
+   for (i = 0; i < tracker->peaks; i++)
+      tracker->sorted[i] = (int) tracker->position[i];
+   if (tracker->peaks > 0)
+      qsort(tracker->sorted, tracker->peaks, sizeof(int), CompareChannels);
+   return 0;
+}
+
+static SEXP SearchTrackerResult(SearchTracker *tracker)
+{
+//list of the deconvolved spectrum (y) and the peaks (pos, 1-based, by
+//height) of the last search, as returned by R_SpectrumSearchHighRes
+   SEXP ans, ans_names, y, pos;
+   int i, n = tracker->peaks > 0 ? tracker->peaks : 0;
+   PROTECT(y = allocVector(REALSXP, tracker->ssize));
+   for (i = 0; i < tracker->ssize; i++)
+      REAL(y)[i] = tracker->peaks >= 0 ? tracker->deconvolved[i] : 0;
+   PROTECT(pos = allocVector(INTSXP, n));
+   for (i = 0; i < n; i++)
+      INTEGER(pos)[i] = (int) tracker->position[i] + 1;
+   PROTECT(ans = allocVector(VECSXP, 2));
+   PROTECT(ans_names = allocVector(STRSXP, 2));
+   SET_STRING_ELT(ans_names, 0, mkChar("pos"));
+   SET_STRING_ELT(ans_names, 1, mkChar("y"));
+   SET_VECTOR_ELT(ans, 0, pos);
+   SET_VECTOR_ELT(ans, 1, y);
+   setAttrib(ans, R_NamesSymbol, ans_names);
+   UNPROTECT(4);
+   return ans;
+}
+
+SEXP R_SpectrumSearchTracker(SEXP R_spectrum, SEXP R_sigma,
+                             SEXP R_threshold, SEXP R_backgroundRemove,
+                             SEXP R_deconIterations, SEXP R_markov,
+                             SEXP R_averWindow, SEXP R_acceleration,
+                             SEXP R_refreshIterations, SEXP R_tolerance)
+{
+/////////////////////////////////////////////////////////////////////////////
+//        NEW PEAK SEARCH TRACKER
+//
+//        R_spectrum-initial spectrum (numeric or integer vector or mapped
+//                   file)
+//        R_refreshIterations-iterations of the deconvolution of the
+//                            searches after an update
+//        R_tolerance-largest move (in channels) of a peak reported as
+//                    moved rather than removed and added
+//        the other parameters are those of R_SpectrumSearchHighRes; the
+//        first search is done here with R_deconIterations iterations
+//
+//        Returns an external pointer to the tracker.
+//
+/////////////////////////////////////////////////////////////////////////////
+   SearchTracker *tracker;
+   const double *spectrum;
+   const char *message;
+   int ssize, i;
+   SEXP ptr, cls;
+
+   SpectrumWorkspaceReset();
+   spectrum = SpectrumInput(R_spectrum, &ssize);
+   if (ssize <= 0)
+      Rf_error( "Wrong Parameters");
+//the object is made first, so no allocation by R can lose the tracker
+   PROTECT(ptr = R_MakeExternalPtr(NULL, install("rPeaksSearchTracker"), R_NilValue));
+   R_RegisterCFinalizerEx(ptr, SearchTrackerFinalizer, TRUE);
+   PROTECT(cls = mkString("rPeaksSearchTracker"));
+   setAttrib(ptr, R_ClassSymbol, cls);
+   tracker = (SearchTracker *) calloc(1, sizeof(SearchTracker));
+   if (tracker == NULL)
+      Rf_error( "Not enough memory for peak search tracker");
+   R_SetExternalPtrAddr(ptr, tracker);
+   tracker->ssize = ssize;
+   tracker->sigma = REAL(R_sigma)[0];
+   tracker->threshold = REAL(R_threshold)[0];
+   tracker->backgroundRemove = INTEGER(R_backgroundRemove)[0];
+   tracker->deconIterations = INTEGER(R_deconIterations)[0];
+   tracker->refreshIterations = INTEGER(R_refreshIterations)[0];
+   tracker->markov = INTEGER(R_markov)[0];
+   tracker->averWindow = INTEGER(R_averWindow)[0];
+   tracker->acceleration = INTEGER(R_acceleration)[0];
+   tracker->tolerance = INTEGER(R_tolerance)[0];
+   tracker->peaks = -1;
+   tracker->size_ext = SpectrumSearchExtended(ssize, tracker->sigma);
+   tracker->spectrum = (double *) malloc((size_t) ssize * sizeof(double));
+   tracker->deconvolved = (double *) malloc((size_t) ssize * sizeof(double));
+   tracker->position = (double *) malloc((size_t) ssize * sizeof(double));
+   tracker->sorted = (int *) malloc((size_t) ssize * sizeof(int));
+   tracker->solution = (double *) malloc((size_t) tracker->size_ext * sizeof(double));
+   tracker->init = (double *) malloc((size_t) tracker->size_ext * sizeof(double));
+   if (tracker->spectrum == NULL || tracker->deconvolved == NULL
+       || tracker->position == NULL || tracker->sorted == NULL
+       || tracker->solution == NULL || tracker->init == NULL)
+      Rf_error( "Not enough memory for peak search tracker");
+   for (i = 0; i < ssize; i++)
+      tracker->spectrum[i] = spectrum[i];
+   message = SearchTrackerRun(tracker, tracker->deconIterations);
+   if (message != 0)
+      Rf_error( "%s", message);
+   UNPROTECT(2);
+   return ptr;
+}
+
+SEXP R_SpectrumSearchUpdate(SEXP R_tracker, SEXP R_channels,
+                            SEXP R_values, SEXP R_add)
+{
+/////////////////////////////////////////////////////////////////////////////
+//        UPDATE OF A PEAK SEARCH TRACKER
+//
+//        R_tracker-tracker made by R_SpectrumSearchTracker
+//        R_channels, R_values, R_add-changed channels as in
+//                                    R_SpectrumBackgroundUpdate
+//
+//        Searches the new spectrum and returns the list of
+//        R_SpectrumSearchHighRes (pos, y) with the peaks which appeared
+//        (added), disappeared (removed) and moved by at most the
+//        tolerance (from, to), all 1-based channels in increasing order.
+//        A peak moved by more is removed and added.
+//
+/////////////////////////////////////////////////////////////////////////////
+   SearchTracker *tracker = TrackerGet(R_tracker, "rPeaksSearchTracker");
+   int *previous, *added, *removed, *from, *to;
+   int old, n, i, j, nadded = 0, nremoved = 0, nmoved = 0;
+   const char *message;
+   double *saved;
+   SEXP ans, ans_names, result, vector;
+
+   old = tracker->peaks > 0 ? tracker->peaks : 0;
+   previous = (int *) R_alloc(old > 0 ? old : 1, sizeof(int));
+   for (i = 0; i < old; i++)
+      previous[i] = tracker->sorted[i];
+   TrackerApply(tracker->spectrum, tracker->ssize, R_channels, R_values,
+                INTEGER(R_add)[0], &saved);
+   message = SearchTrackerRun(tracker, tracker->refreshIterations);
+//a failed search keeps the previous one, of the previous spectrum
+   if (message != 0) {
+      TrackerRestore(tracker->spectrum, R_channels, saved);
+      Rf_error( "%s", message);
+   }
+   n = tracker->peaks > 0 ? tracker->peaks : 0;
+
+//both lists are in increasing order, a peak is matched with the first
+//unmatched peak of the other list within the tolerance
+   added = (int *) R_alloc(n > 0 ? n : 1, sizeof(int));
+   removed = (int *) R_alloc(old > 0 ? old : 1, sizeof(int));
+   from = (int *) R_alloc(old > 0 ? old : 1, sizeof(int));
+   to = (int *) R_alloc(old > 0 ? old : 1, sizeof(int));
+   for (i = 0, j = 0; i < old || j < n;) {
+      if (j == n || (i < old && previous[i] < tracker->sorted[j] - tracker->tolerance))
+         removed[nremoved++] = previous[i++];
+
+      else if (i == old || tracker->sorted[j] < previous[i] - tracker->tolerance)
+         added[nadded++] = tracker->sorted[j++];
+
+      else {
+         if (previous[i] != tracker->sorted[j]) {
+            from[nmoved] = previous[i];
+            to[nmoved++] = tracker->sorted[j];
+         }
+         i++, j++;
+      }
+   }
+   PROTECT(result = SearchTrackerResult(tracker));
+   PROTECT(ans = allocVector(VECSXP, 6));
+   PROTECT(ans_names = allocVector(STRSXP, 6));
+   SET_VECTOR_ELT(ans, 0, VECTOR_ELT(result, 0));
+   SET_VECTOR_ELT(ans, 1, VECTOR_ELT(result, 1));
+   vector = allocVector(INTSXP, nadded);
+   SET_VECTOR_ELT(ans, 2, vector);
+   for (i = 0; i < nadded; i++)
+      INTEGER(vector)[i] = added[i] + 1;
+   vector = allocVector(INTSXP, nremoved);
+   SET_VECTOR_ELT(ans, 3, vector);
+   for (i = 0; i < nremoved; i++)
+      INTEGER(vector)[i] = removed[i] + 1;
+   vector = allocVector(INTSXP, nmoved);
+   SET_VECTOR_ELT(ans, 4, vector);
+   for (i = 0; i < nmoved; i++)
+      INTEGER(vector)[i] = from[i] + 1;
+   vector = allocVector(INTSXP, nmoved);
+   SET_VECTOR_ELT(ans, 5, vector);
+   for (i = 0; i < nmoved; i++)
+      INTEGER(vector)[i] = to[i] + 1;
+   SET_STRING_ELT(ans_names, 0, mkChar("pos"));
+   SET_STRING_ELT(ans_names, 1, mkChar("y"));
+   SET_STRING_ELT(ans_names, 2, mkChar("added"));
+   SET_STRING_ELT(ans_names, 3, mkChar("removed"));
+   SET_STRING_ELT(ans_names, 4, mkChar("from"));
+   SET_STRING_ELT(ans_names, 5, mkChar("to"));
+   setAttrib(ans, R_NamesSymbol, ans_names);
+   UNPROTECT(3);
+   return ans;
+}
+
+SEXP R_SpectrumSearchCurrent(SEXP R_tracker)
+{
+/////////////////////////////////////////////////////////////////////////////
+//        Result of the last search of a tracker, as R_SpectrumSearchHighRes
+/////////////////////////////////////////////////////////////////////////////
+   SearchTracker *tracker = TrackerGet(R_tracker, "rPeaksSearchTracker");
+   return SearchTrackerResult(tracker);
+}
@@ -0,0 +1,199 @@
+//__________________________________________________________________________
+//   WORKING SPACE ARENA                                                   //
+//                                                                         //
+//   The spectra processing functions need several vectors of the size of  //
+//   the spectrum as a scratch area. They used to be variable length       //
+//   arrays on the C stack, which overflows for spectra with more than a   //
+//   few ten thousands of channels. The working space is now taken from a  //
+//   per-thread arena which is grown once and then reused by all calls.    //
+//____________________________________________________________________________
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#include <R.h>
+#include <Rinternals.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include "spectrum.h"
+
+#define WORKSPACE_ALIGN 64
+#define WORKSPACE_GRAIN (WORKSPACE_ALIGN / sizeof(double))
+
+typedef struct WorkspaceBlock {
+   struct WorkspaceBlock *next;
+   void *raw;
+   size_t start;                  //arena position of the block
+} WorkspaceBlock;
+
+typedef struct Workspace {
+   struct Workspace *next;        //list of the arenas of all threads
+   void *raw;                     //memory obtained from malloc
+   double *data;                  //aligned begin of the arena
+   size_t capacity;               //number of doubles in data
+   size_t used;                   //doubles handed out, blocks included
+   size_t peak;                   //maximum of used since the last regrow
+   WorkspaceBlock *blocks;        //temporary blocks, newest first
+} Workspace;
+
+static SPECTRUM_THREAD_LOCAL Workspace *workspace;   //arena of this thread
+static Workspace *workspaces;     //all arenas, see WorkspaceThread
+
+static double *WorkspaceAlign(void *raw)
+{
+   uintptr_t p = (uintptr_t) raw;
+   p = (p + WORKSPACE_ALIGN - 1) & ~(uintptr_t) (WORKSPACE_ALIGN - 1);
+   return (double *) p;
+}
+
+static Workspace *WorkspaceThread(void)
+{
+//arena of the calling thread, created on first use. Every arena is kept in
+//the list workspaces, so the master thread can free the arenas of OpenMP
+//worker threads it cannot run on, whatever the size of the team was
+   Workspace *ws = workspace;
+   if (ws == NULL) {
+      ws = calloc(1, sizeof(Workspace));
+      if (ws == NULL)
+         return NULL;
+#ifdef _OPENMP
+#pragma omp critical(rPeaksWorkspaceList)
+#endif
+      {
+         ws->next = workspaces;
+         workspaces = ws;
+      }
+      workspace = ws;
+   }
+   return ws;
+}
+
+size_t SpectrumWorkspaceMark(void)
+{
+   return workspace != NULL ? workspace->used : 0;
+}
+
+double *SpectrumWorkspaceAlloc(size_t n)
+{
+/////////////////////////////////////////////////////////////////////////////
+//        Returns n uninitialized doubles aligned to 64 bytes.
+//        Once a temporary block was needed all following requests are
+//        served from blocks as well, so the arena is always released in
+//        the order it was allocated.
+/////////////////////////////////////////////////////////////////////////////
+   Workspace *ws = WorkspaceThread();
+   WorkspaceBlock *block;
+   double *p;
+   if (ws == NULL)
+      return NULL;
+   n = (n + WORKSPACE_GRAIN - 1) / WORKSPACE_GRAIN * WORKSPACE_GRAIN;
+   if (n == 0)
+      n = WORKSPACE_GRAIN;
+   if (n > (SIZE_MAX - WORKSPACE_ALIGN) / sizeof(double))
+      return NULL;
+   if (ws->blocks == NULL && ws->used + n <= ws->capacity)
+      p = ws->data + ws->used;
+
+   else{
+      block = malloc(sizeof(WorkspaceBlock));
+      if (block == NULL)
+         return NULL;
+      block->raw = malloc(n * sizeof(double) + WORKSPACE_ALIGN);
+      if (block->raw == NULL) {
+         free(block);
+         return NULL;
+      }
+      block->start = ws->used;
+      block->next = ws->blocks;
+      ws->blocks = block;
+      p = WorkspaceAlign(block->raw);
+   }
+   ws->used += n;
+   if (ws->peak < ws->used)
+      ws->peak = ws->used;
+   return p;
+}
+
+void SpectrumWorkspaceRelease(size_t mark)
+{
+   Workspace *ws = workspace;
+   WorkspaceBlock *block;
+   if (ws == NULL)
+      return;
+   while (ws->blocks != NULL && ws->blocks->start >= mark) {
+      block = ws->blocks;
+      ws->blocks = block->next;
+      free(block->raw);
+      free(block);
+   }
+   if (mark < ws->used)
+      ws->used = mark;
+
+//regrow the arena to the largest size needed so far
+   if (ws->used == 0 && ws->peak > ws->capacity) {
+      free(ws->raw);
+      ws->raw = malloc(ws->peak * sizeof(double) + WORKSPACE_ALIGN);
+      if (ws->raw == NULL) {
+         ws->data = NULL;
+         ws->capacity = 0;
+      }
+
+      else{
+         ws->data = WorkspaceAlign(ws->raw);
+         ws->capacity = ws->peak;
+      }
+   }
+}
+
+void SpectrumWorkspaceReset(void)
+{
+   SpectrumWorkspaceRelease(0);
+}
+
+void SpectrumWorkspaceFree(void)
+{
+/////////////////////////////////////////////////////////////////////////////
+//        Frees the arenas of all threads. Must be called outside of any
+//        parallel region, when no arena is in use.
+/////////////////////////////////////////////////////////////////////////////
+   Workspace *ws;
+   WorkspaceBlock *block;
+#ifdef _OPENMP
+#pragma omp critical(rPeaksWorkspaceList)
+#endif
+   for (ws = workspaces; ws != NULL; ws = ws->next) {
+      while (ws->blocks != NULL) {
+         block = ws->blocks;
+         ws->blocks = block->next;
+         free(block->raw);
+         free(block);
+      }
+      free(ws->raw);
+      ws->raw = NULL;
+      ws->data = NULL;
+      ws->capacity = 0;
+      ws->used = 0;
+      ws->peak = 0;
+   }
+}
+
+int SpectrumThreads(int threads)
+{
+//number of threads requested from R, NA or < 1 means all processors
+#ifdef _OPENMP
+   if (threads == NA_INTEGER || threads < 1)
+      threads = omp_get_num_procs();
+#else
+   threads = 1;
+#endif
+   return threads;
+}
+
+SEXP R_SpectrumWorkspaceFree(void)
+{
+//the arenas of the OpenMP worker threads of the batch functions as well
+   SpectrumWorkspaceFree();
+   return R_NilValue;
+}